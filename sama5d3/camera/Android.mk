@@ -5,6 +5,10 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_SRC_FILES:=               \
     CameraHardwareSam.cpp					\
     V4L2Camera.cpp              \
+    CameraStats.cpp             \
+    CameraConvert.cpp           \
+    CameraTrace.cpp             \
+    cctables.cpp                \
     ccrgb16toyuv420.cpp
 
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
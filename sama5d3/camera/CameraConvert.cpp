@@ -0,0 +1,197 @@
+/*
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License
+*/
+
+#include "CameraConvert.h"
+#include "cctables.h"
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define YV12_ALIGN(x)   (((x) + 15) & ~15)
+
+/*
+ * Two YUYV lines to two luma lines and one line of averaged chroma.
+ * uv_step is 2 for interleaved VU (NV21) and 1 for separate planes.
+ */
+static void yuyv_rows_to_420(const uint8_t *s0, const uint8_t *s1,
+                             uint8_t *y0, uint8_t *y1,
+                             uint8_t *v, uint8_t *u, int uv_step, int width)
+{
+    int x = 0;
+
+#if defined(__ARM_NEON__)
+    /* 16 pixels per step: val[0]/val[2] even/odd luma, val[1] U, val[3] V */
+    for (; x + 16 <= width; x += 16) {
+        uint8x8x4_t a = vld4_u8(s0 + x * 2);
+        uint8x8x4_t b = vld4_u8(s1 + x * 2);
+        uint8x8x2_t ya, yb;
+        uint8x8_t cu = vrhadd_u8(a.val[1], b.val[1]);
+        uint8x8_t cv = vrhadd_u8(a.val[3], b.val[3]);
+
+        ya.val[0] = a.val[0];
+        ya.val[1] = a.val[2];
+        yb.val[0] = b.val[0];
+        yb.val[1] = b.val[2];
+        vst2_u8(y0 + x, ya);
+        vst2_u8(y1 + x, yb);
+
+        if (uv_step == 2) {
+            uint8x8x2_t vu;
+
+            vu.val[0] = cv;
+            vu.val[1] = cu;
+            vst2_u8(v + x, vu);
+        } else {
+            vst1_u8(v + x / 2, cv);
+            vst1_u8(u + x / 2, cu);
+        }
+    }
+#endif
+
+    for (; x < width; x += 2) {
+        const uint8_t *p0 = s0 + x * 2;
+        const uint8_t *p1 = s1 + x * 2;
+        int c = (x / 2) * uv_step;
+
+        y0[x] = p0[0];
+        y0[x + 1] = p0[2];
+        y1[x] = p1[0];
+        y1[x + 1] = p1[2];
+        u[c] = (p0[1] + p1[1] + 1) >> 1;
+        v[c] = (p0[3] + p1[3] + 1) >> 1;
+    }
+}
+
+int nv21_frame_size(int width, int height)
+{
+    return width * height * 3 / 2;
+}
+
+void yuyv_to_nv21(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    uint8_t *vu = dst + width * height;
+    int pitch = width * 2;
+
+    for (int y = 0; y < height; y += 2) {
+        const uint8_t *s = src + y * pitch;
+        uint8_t *d = dst + y * width;
+
+        yuyv_rows_to_420(s, s + pitch, d, d + width,
+                         vu, vu + 1, 2, width);
+        vu += width;
+    }
+}
+
+int yv12_frame_size(int width, int height)
+{
+    int stride = YV12_ALIGN(width);
+    int c_stride = YV12_ALIGN(stride / 2);
+
+    return stride * height + c_stride * height;
+}
+
+void yuyv_to_yv12(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    int stride = YV12_ALIGN(width);
+    int c_stride = YV12_ALIGN(stride / 2);
+    uint8_t *v = dst + stride * height;
+    uint8_t *u = v + c_stride * (height / 2);
+    int pitch = width * 2;
+
+    for (int y = 0; y < height; y += 2) {
+        const uint8_t *s = src + y * pitch;
+        uint8_t *d = dst + y * stride;
+
+        yuyv_rows_to_420(s, s + pitch, d, d + stride, v, u, 1, width);
+        v += c_stride;
+        u += c_stride;
+    }
+}
+
+void yuyv_to_i420(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    uint8_t *u = dst + width * height;
+    uint8_t *v = u + (width / 2) * (height / 2);
+    int pitch = width * 2;
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t *s = src + y * pitch;
+
+        for (int x = 0; x < width; x++)
+            *dst++ = s[x * 2];
+    }
+    for (int y = 0; y < height; y += 2) {
+        const uint8_t *s = src + y * pitch;
+
+        for (int x = 0; x < width; x += 2) {
+            *u++ = s[x * 2 + 1];
+            *v++ = s[x * 2 + 3];
+        }
+    }
+}
+
+/* rv, guv and bu are the chroma terms shared by both pixels of a pair */
+static inline void yuv_to_rgb16(uint8_t y, int rv, int guv, int bu, uint8_t *rgb)
+{
+    int y1 = cc_yuv_y_table[y];
+    int r = CC_CLIP((y1 + rv) >> 10);
+    int g = CC_CLIP((y1 - guv) >> 10);
+    int b = CC_CLIP((y1 + bu) >> 10);
+    int rgb16 = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+
+    rgb[0] = rgb16 & 0xff;
+    rgb[1] = rgb16 >> 8;
+}
+
+void uyvy_to_rgb565(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    int blocks = width * height * 2;
+
+    for (int i = 0; i < blocks; i += 4) {
+        uint8_t u = src[i + 0];
+        uint8_t v = src[i + 2];
+        int rv = cc_yuv_rv_table[v];
+        int guv = cc_yuv_gv_table[v] + cc_yuv_gu_table[u];
+        int bu = cc_yuv_bu_table[u];
+
+        yuv_to_rgb16(src[i + 1], rv, guv, bu, &dst[i]);
+        yuv_to_rgb16(src[i + 3], rv, guv, bu, &dst[i + 2]);
+    }
+}
+
+void yvyu_to_rgb888_line(const uint8_t *src, uint8_t *dst, int width)
+{
+    for (int x = 0; x < width; x += 2) {
+        uint8_t v = src[1];
+        uint8_t u = src[3];
+        int rv = cc_yuv_rv_table[v];
+        int guv = cc_yuv_gv_table[v] + cc_yuv_gu_table[u];
+        int bu = cc_yuv_bu_table[u];
+        int y1;
+
+        y1 = cc_yuv_y_table[src[0]];
+        *dst++ = CC_CLIP((y1 + rv) >> 10);
+        *dst++ = CC_CLIP((y1 - guv) >> 10);
+        *dst++ = CC_CLIP((y1 + bu) >> 10);
+
+        y1 = cc_yuv_y_table[src[2]];
+        *dst++ = CC_CLIP((y1 + rv) >> 10);
+        *dst++ = CC_CLIP((y1 - guv) >> 10);
+        *dst++ = CC_CLIP((y1 + bu) >> 10);
+
+        src += 4;
+    }
+}
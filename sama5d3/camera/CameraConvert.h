@@ -0,0 +1,49 @@
+/*
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License
+*/
+
+#ifndef ANDROID_HARDWARE_CAMERA_CONVERT_H
+#define ANDROID_HARDWARE_CAMERA_CONVERT_H
+
+#include <stdint.h>
+
+/* Repacking of the YUYV preview frames into the 4:2:0 layouts expected by
+ * CAMERA_MSG_PREVIEW_FRAME clients. Chroma is the rounded average of the
+ * two source lines. Width and height must be even. Like CameraStats, no
+ * Android dependency.
+ */
+
+/* NV21 (YUV420SP): Y plane, then interleaved V/U, packed */
+int  nv21_frame_size(int width, int height);
+void yuyv_to_nv21(const uint8_t *src, uint8_t *dst, int width, int height);
+
+/* YV12 (YUV420P) as defined by Android: Y stride aligned to 16, V plane
+ * then U plane, each with a stride of half the Y stride aligned to 16.
+ */
+int  yv12_frame_size(int width, int height);
+void yuyv_to_yv12(const uint8_t *src, uint8_t *dst, int width, int height);
+
+/* Legacy planar repack behind CameraHardwareSam::YUY2toYV12(): Y, then
+ * U, then V, all packed, chroma taken from the even lines only.
+ */
+void yuyv_to_i420(const uint8_t *src, uint8_t *dst, int width, int height);
+
+/* YUV to RGB through the cctables lookups, width must be even.
+ * uyvy_to_rgb565() is the preview path (V4L2Camera::convert), the RGB888
+ * one converts a single YVYU line for the JPEG encoder.
+ */
+void uyvy_to_rgb565(const uint8_t *src, uint8_t *dst, int width, int height);
+void yvyu_to_rgb888_line(const uint8_t *src, uint8_t *dst, int width);
+
+#endif
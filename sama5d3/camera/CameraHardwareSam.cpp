@@ -17,6 +17,9 @@
 #include <utils/Log.h>
 #include "V4L2Camera.h"
 #include "CameraHardwareSam.h"
+#include "CameraStats.h"
+#include "CameraConvert.h"
+#include "CameraTrace.h"
 #include <camera/Camera.h>
 #include <utils/threads.h>
 #include <fcntl.h>
@@ -24,6 +27,10 @@
 #include <unistd.h>
 #include <hardware/hardware.h>
 #include <signal.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 extern "C" {
 #include<unistd.h>
@@ -34,7 +41,29 @@ extern "C" {
 
 namespace android {
 static const int INITIAL_SKIP_FRAME = 3;
+static const int AE_SKIP_FRAME = 30;
 static const int EFFECT_SKIP_FRAME = 1;
+
+/* adaptive capture queue: looked at once per window */
+static const int BUFFER_ADAPT_WINDOW = 60;  /* frames */
+static const int BUFFER_ADAPT_DROPS = 2;    /* drops in a window to grow */
+static const int LOW_MEMORY_KB = 16384;     /* MemFree + Cached to shrink */
+
+/* contrast autofocus tuning */
+static const int AF_COARSE_STEPS = 10;      /* coarse step = range / this */
+static const int AF_SETTLE_FRAMES = 2;      /* frames exposed while the lens moves */
+static const int AF_MAX_DROPS = 2;          /* drops in a row before turning back */
+static const int AF_MAX_MOVES = 40;
+static const nsecs_t AF_FRAME_TIMEOUT = 500000000LL;
+/* GRALLOC_USAGE_SAM_OVERLAY in libgralloc/gralloc_priv.h: the buffer comes
+ * out of memory the LCDC fetches, so the hwcomposer queues it to the HEO
+ * as it is instead of copying it again */
+static const int PREVIEW_USAGE_OVERLAY = GRALLOC_USAGE_PRIVATE_0;
+
+static const char * const kThreadNames[CAMERA_THREAD_MAX] = {
+    "preview", "callback", "encode",
+};
+
 bool CameraHardwareSam::mInitialed = false;
 gralloc_module_t const* CameraHardwareSam::mGrallocHal;
 
@@ -42,8 +71,10 @@ CameraHardwareSam::CameraHardwareSam(int cameraId, camera_device_t *dev)
     : mCaptureInProgress(false),
       mParameters(),
       mPreviewHeap(0),
+      mPreviewCbHeap(0),
       mRawHeap(0),
       mV4L2Camera(NULL),
+      mCameraId(cameraId),
 #if defined(BOARD_USES_OVERLAY)
       mUseOverlay(false),
       mOverlayBufferIdx(0),
@@ -62,7 +93,12 @@ CameraHardwareSam::CameraHardwareSam(int cameraId, camera_device_t *dev)
     mV4L2Camera = V4L2Camera::createInstance();
     mRawHeap = NULL;
     mPreviewHeap = NULL;
+    mPreviewCbHeap = NULL;
+    mPreviewCbFrameSize = 0;
+    mPreviewCbIndex = 0;
     mRecordHeap = NULL;
+    mRecordFrameSize = 0;
+    mRecordSending = false;
 
     if (!mGrallocHal) {
         ret = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, (const hw_module_t **)&mGrallocHal);
@@ -75,6 +111,8 @@ CameraHardwareSam::CameraHardwareSam(int cameraId, camera_device_t *dev)
         return;
     }
 
+    camera_trace_init();
+
     ret = mV4L2Camera->initCamera(cameraId);
 
     if (ret < 0) {
@@ -82,8 +120,6 @@ CameraHardwareSam::CameraHardwareSam(int cameraId, camera_device_t *dev)
         return;
     }
 
-    initDefaultParameters(cameraId);
-
     mExitAutoFocusThread = false;
     mExitPreviewThread = false;
     /* whether the PreviewThread is active in preview or stopped.  we
@@ -91,6 +127,33 @@ CameraHardwareSam::CameraHardwareSam(int cameraId, camera_device_t *dev)
      */
     mPreviewRunning = false;
     mPreviewStartDeferred = false;
+    mPreviewSwitchPending = false;
+    mBufferCount = mV4L2Camera->getBufferCount();
+    mAdaptFrames = 0;
+    mAdaptDropped = 0;
+    property_get("camera.buffers.adaptive", value, "1");
+    mBufferAdaptive = atoi(value) != 0;
+    property_get("camera.buffers.lowmem_kb", value, "0");
+    mLowMemoryKb = atoi(value) > 0 ? atoi(value) : LOW_MEMORY_KB;
+    property_get("camera.preview.overlay", value, "1");
+    mPreviewOverlay = atoi(value) != 0;
+    mSkipFrame = 0;
+    mAeSkipFrame = 0;
+    mFocusSharpness = 0;
+    mFocusFrameCount = 0;
+    mFocusCancelled = false;
+    mFocusSupported = false;
+    memset(&mConfig, 0, sizeof(mConfig));
+    mConfigValid = false;
+    mCallbackHead = 0;
+    mCallbackCount = 0;
+    mCallbackInFlight = 0;
+    mExitCallbackThread = false;
+    memset(mThreadSched, 0, sizeof(mThreadSched));
+
+    initDefaultParameters(cameraId);
+
+    mCallbackThread = new CallbackThread(this);
     mPreviewThread = new PreviewThread(this);
     mPictureThread = new PictureThread(this);
     mAutoFocusThread = new AutoFocusThread(this);
@@ -99,7 +162,7 @@ CameraHardwareSam::CameraHardwareSam(int cameraId, camera_device_t *dev)
 
 int CameraHardwareSam::getCameraId() const
 {
-    return mV4L2Camera->getCameraId();
+    return mCameraId;
 }
 
 void CameraHardwareSam::initDefaultParameters(int cameraId)
@@ -110,6 +173,7 @@ void CameraHardwareSam::initDefaultParameters(int cameraId)
     }
 
     CameraParameters p;
+    String8 parameterString;
 
     p.set(CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES,
           "1600x1200,1280x1024,1024x768,800x600,640x480,352x288,320x240,176x144");
@@ -138,8 +202,16 @@ void CameraHardwareSam::initDefaultParameters(int cameraId)
     p.setPictureSize(snapshot_max_width, snapshot_max_height);
     p.set(CameraParameters::KEY_JPEG_QUALITY, "100"); // maximum quality
 
+    /* the sensor always delivers YUYV, the 4:2:0 formats are only
+     * produced for CAMERA_MSG_PREVIEW_FRAME
+     */
+    parameterString = CameraParameters::PIXEL_FORMAT_YUV420SP;
+    parameterString.append(",");
+    parameterString.append(CameraParameters::PIXEL_FORMAT_YUV420P);
+    parameterString.append(",");
+    parameterString.append(CameraParameters::PIXEL_FORMAT_YUV422I);
     p.set(CameraParameters::KEY_SUPPORTED_PREVIEW_FORMATS,
-          CameraParameters::PIXEL_FORMAT_YUV420SP);
+          parameterString.string());
     p.set(CameraParameters::KEY_SUPPORTED_PICTURE_FORMATS,
           CameraParameters::PIXEL_FORMAT_JPEG);
     p.set(CameraParameters::KEY_VIDEO_FRAME_FORMAT,
@@ -148,7 +220,22 @@ void CameraHardwareSam::initDefaultParameters(int cameraId)
     p.set(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY, "100");
 
     p.set(CameraParameters::KEY_ROTATION, 0);
-    p.set(CameraParameters::KEY_WHITE_BALANCE, CameraParameters::WHITE_BALANCE_DAYLIGHT);
+
+    parameterString = CameraParameters::WHITE_BALANCE_AUTO;
+    if (mV4L2Camera->hasControl(V4L2_CID_AUTO_WHITE_BALANCE) &&
+        mV4L2Camera->hasControl(V4L2_CID_WHITE_BALANCE_TEMPERATURE)) {
+        parameterString.append(",");
+        parameterString.append(CameraParameters::WHITE_BALANCE_INCANDESCENT);
+        parameterString.append(",");
+        parameterString.append(CameraParameters::WHITE_BALANCE_FLUORESCENT);
+        parameterString.append(",");
+        parameterString.append(CameraParameters::WHITE_BALANCE_DAYLIGHT);
+        parameterString.append(",");
+        parameterString.append(CameraParameters::WHITE_BALANCE_CLOUDY_DAYLIGHT);
+    }
+    p.set(CameraParameters::KEY_SUPPORTED_WHITE_BALANCE,
+          parameterString.string());
+    p.set(CameraParameters::KEY_WHITE_BALANCE, CameraParameters::WHITE_BALANCE_AUTO);
 
     p.set(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE, "(15000,30000)");
     p.set(CameraParameters::KEY_PREVIEW_FPS_RANGE, "15000,30000");
@@ -157,12 +244,22 @@ void CameraHardwareSam::initDefaultParameters(int cameraId)
 
     p.setPreviewFrameRate(20);
 
-    String8 parameterString;
-    parameterString = CameraParameters::FOCUS_MODE_FIXED;
-    p.set(CameraParameters::KEY_SUPPORTED_FOCUS_MODES,
-          parameterString.string());
-    p.set(CameraParameters::KEY_FOCUS_MODE,
-          CameraParameters::FOCUS_MODE_FIXED);
+    mFocusSupported = mV4L2Camera->hasControl(V4L2_CID_FOCUS_ABSOLUTE);
+    if (mFocusSupported) {
+        parameterString = CameraParameters::FOCUS_MODE_AUTO;
+        parameterString.append(",");
+        parameterString.append(CameraParameters::FOCUS_MODE_FIXED);
+        p.set(CameraParameters::KEY_SUPPORTED_FOCUS_MODES,
+              parameterString.string());
+        p.set(CameraParameters::KEY_FOCUS_MODE,
+              CameraParameters::FOCUS_MODE_AUTO);
+    } else {
+        parameterString = CameraParameters::FOCUS_MODE_FIXED;
+        p.set(CameraParameters::KEY_SUPPORTED_FOCUS_MODES,
+              parameterString.string());
+        p.set(CameraParameters::KEY_FOCUS_MODE,
+              CameraParameters::FOCUS_MODE_FIXED);
+    }
     p.set(CameraParameters::KEY_FOCUS_DISTANCES,
           FRONT_CAMERA_FOCUS_DISTANCES_STR);
 
@@ -251,24 +348,101 @@ int CameraHardwareSam::previewThreadWrapper()
             return 0;
         }
         previewThread();
+
+        /* swap to a new resolution or queue depth between two frames */
+        mPreviewLock.lock();
+        if (!mPreviewSwitchPending && mPreviewRunning)
+            adaptBufferCount();
+        if (mPreviewSwitchPending && mPreviewRunning) {
+            mPreviewSwitchPending = false;
+            if (switchPreviewInternal() != NO_ERROR)
+                LOGE("ERR(%s):preview resolution switch failed", __func__);
+        }
+        mPreviewLock.unlock();
     }
 }
 
+/* MemFree + Cached from /proc/meminfo, -1 if it can't be read */
+static int available_memory_kb(void)
+{
+    char line[128];
+    int free_kb = -1, cached_kb = -1, value;
+    FILE *fp = fopen("/proc/meminfo", "r");
+
+    if (fp == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "MemFree: %d kB", &value) == 1)
+            free_kb = value;
+        else if (sscanf(line, "Cached: %d kB", &value) == 1)
+            cached_kb = value;
+    }
+    fclose(fp);
+
+    if (free_kb < 0 || cached_kb < 0)
+        return -1;
+    return free_kb + cached_kb;
+}
+
+/* Called with mPreviewLock held, between two frames. Once per window,
+ * one more capture buffer if the ISI dropped frames, one less if the
+ * system runs low on memory. The new depth is picked up by the same
+ * switch as a resolution change.
+ */
+void CameraHardwareSam::adaptBufferCount()
+{
+    int dropped, drops, available, target;
+    int width, height, frame_size;
+
+    if (!mBufferAdaptive || ++mAdaptFrames < BUFFER_ADAPT_WINDOW)
+        return;
+    mAdaptFrames = 0;
+
+    dropped = mV4L2Camera->getDroppedFrames();
+    drops = dropped - mAdaptDropped;
+    mAdaptDropped = dropped;
+
+    target = mBufferCount;
+    available = available_memory_kb();
+    if (available >= 0 && available < mLowMemoryKb) {
+        if (target > MIN_BUFFERS)
+            target--;
+    } else if (drops >= BUFFER_ADAPT_DROPS && target < MAX_BUFFERS)
+        target++;
+
+    if (target == mBufferCount)
+        return;
+
+    LOGI("%s : %d dropped, %d kB available, %d -> %d capture buffers",
+         __func__, drops, available, mBufferCount, target);
+
+    mV4L2Camera->getPreviewSize(&width, &height, &frame_size);
+    mV4L2Camera->setBufferCount(target);
+    mPendingPreviewWidth  = width;
+    mPendingPreviewHeight = height;
+    mPendingPreviewFormat = mV4L2Camera->getPreviewPixelFormat();
+    mPreviewSwitchPending = true;
+}
+
 int CameraHardwareSam::previewThread()
 {
     int index = 0;
     int width, height, frame_size, offset, page_size;
+    bool ae_converged = true;
+    bool skip = false;
+    char *frame;
     nsecs_t timestamp;
 
     LOGV("%s:",__func__);
 
-    index = mV4L2Camera->getPreviewframe();
+    index = mV4L2Camera->getPreviewframe(&timestamp);
     if (index < 0) {
         LOGE("ERR(%s):Fail on mV4L2Camera->getPreview()", __func__);
         return UNKNOWN_ERROR;
     }
 
-    if (index == kBufferCount) {
+    if (index >= mBufferCount) {
         mV4L2Camera->freePreviewframe(index);
         return NO_ERROR;
     }
@@ -280,6 +454,34 @@ int CameraHardwareSam::previewThread()
     LOGV("mPreviewHeap(fd(%d), size(%d), width(%d), height(%d))",
          mV4L2Camera->getCameraFd(), frame_size, width, height);
 
+    frame = ((char *)mPreviewHeap->data) + offset;
+
+    if (mV4L2Camera->autoExposureEnabled()) {
+        struct yuyv_stats stats;
+
+        yuyv_exposure_stats((uint8_t *)frame, width, height, &stats);
+        ae_converged = mV4L2Camera->updateAutoExposure(&stats);
+    }
+
+    if (mFocusSupported)
+        updateFocusStats((uint8_t *)frame, width, height);
+
+    /* hold the first frames back, and more until exposure settles */
+    mSkipFrameLock.lock();
+    if (mSkipFrame > 0) {
+        mSkipFrame--;
+        skip = true;
+    } else if (mAeSkipFrame > 0) {
+        mAeSkipFrame = ae_converged ? 0 : mAeSkipFrame - 1;
+        skip = !ae_converged;
+    }
+    mSkipFrameLock.unlock();
+
+    if (skip) {
+        mV4L2Camera->freePreviewframe(index);
+        return NO_ERROR;
+    }
+
     if (mPreviewWindow && mGrallocHal) {
         buffer_handle_t *buf_handle;
         int stride;
@@ -288,13 +490,16 @@ int CameraHardwareSam::previewThread()
             goto callbacks;
         }
 
+        /* the one copy left on the preview path: the ISI captures into its
+         * own buffers, which the callbacks and recording read, and only
+         * the hwcomposer fetches the window buffer in place. lock waits
+         * while the HEO still has it, see private_handle_t::scanout() */
         void *vaddr;
+        CAMERA_TRACE_BEGIN("grallocCopy");
         if (!mGrallocHal->lock(mGrallocHal,
                                *buf_handle,
                                GRALLOC_USAGE_SW_WRITE_OFTEN,
                                0, 0, width, height, &vaddr)) {
-            char *frame = ((char *)mPreviewHeap->data) + offset;
-
             // the code below assumes YUV, not RGB
             {
                 int h;
@@ -307,7 +512,9 @@ int CameraHardwareSam::previewThread()
         }
         else
             LOGE("%s: could not obtain gralloc buffer", __func__);
+        CAMERA_TRACE_END();
 
+        mPreviewWindow->set_timestamp(mPreviewWindow, timestamp);
         if (0 != mPreviewWindow->enqueue_buffer(mPreviewWindow, buf_handle)) {
             LOGE("Could not enqueue gralloc buffer!\n");
             goto callbacks;
@@ -315,14 +522,239 @@ int CameraHardwareSam::previewThread()
     }
 callbacks:
     // Notify the client of a new frame.
-    if (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) {
+    if (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME)
+        sendPreviewFrame((uint8_t *)frame, index, width, height);
+
+    if (mRecordRunning && (mMsgEnabled & CAMERA_MSG_VIDEO_FRAME))
+        sendRecordFrame((uint8_t *)frame, timestamp, width, height);
+
+    mV4L2Camera->freePreviewframe(index);
+    return NO_ERROR;
+}
+
+/* Video frames are YV12 copies of the capture buffer, stamped with the
+ * time the sensor delivered it rather than the time we got around to
+ * it. A slot stays busy until the encoder hands it back through
+ * releaseRecordingFrame(); with none free the frame is dropped. The
+ * encoder may do that from inside the callback, so it runs unlocked;
+ * stopRecording() waits for it before freeing the heap.
+ */
+void CameraHardwareSam::sendRecordFrame(const uint8_t *frame, nsecs_t timestamp,
+                                        int width, int height)
+{
+    camera_memory_t *heap;
+    int slot;
+
+    mRecordLock.lock();
+
+    if (!mRecordRunning || !mRecordHeap) {
+        mRecordLock.unlock();
+        return;
+    }
+
+    if (yv12_frame_size(width, height) != mRecordFrameSize) {
+        LOGE("ERR(%s):Preview size changed while recording", __func__);
+        mRecordLock.unlock();
+        return;
+    }
+
+    for (slot = 0; slot < kBufferCountForRecord; slot++)
+        if (!mRecordBusy[slot])
+            break;
+    if (slot == kBufferCountForRecord) {
+        LOGV("%s : encoder is behind, dropping frame", __func__);
+        mRecordLock.unlock();
+        return;
+    }
+
+    heap = mRecordHeap;
+    yuyv_to_yv12(frame, (uint8_t *)heap->data + slot * mRecordFrameSize,
+                 width, height);
+    mRecordBusy[slot] = true;
+    mRecordSending = true;
+    mRecordLock.unlock();
+
+    CAMERA_TRACE_BEGIN("dataCbTimestamp");
+    mDataCbTimestamp(timestamp, CAMERA_MSG_VIDEO_FRAME, heap, slot,
+                     mCallbackCookie);
+    CAMERA_TRACE_END();
+
+    mRecordLock.lock();
+    mRecordSending = false;
+    mRecordCondition.broadcast();
+    mRecordLock.unlock();
+}
+
+/* YUYV goes out straight from the capture buffer. NV21 and YV12 are
+ * converted into a separate pool of kBufferCount frames, used round
+ * robin, and delivered by the callback thread. A frame is dropped when
+ * every slot is still with the client.
+ */
+void CameraHardwareSam::sendPreviewFrame(const uint8_t *frame, int index,
+                                         int width, int height)
+{
+    int format = mConfig.preview_cb_format;
+    int size;
+    uint8_t *dst;
+
+    if (format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
+        CAMERA_TRACE_BEGIN("dataCb");
         mDataCb(CAMERA_MSG_PREVIEW_FRAME, mPreviewHeap, index, NULL, mCallbackCookie);
+        CAMERA_TRACE_END();
+        return;
     }
 
-    mV4L2Camera->freePreviewframe(index);
+    if (format == HAL_PIXEL_FORMAT_YV12)
+        size = yv12_frame_size(width, height);
+    else
+        size = nv21_frame_size(width, height);
+
+    mCallbackLock.lock();
+    if (mCallbackInFlight >= kBufferCount ||
+            (mCallbackInFlight > 0 && mPreviewCbFrameSize != size)) {
+        LOGV("%s : client is behind, dropping frame", __func__);
+        mCallbackLock.unlock();
+        return;
+    }
+    mCallbackLock.unlock();
+
+    /* nothing in flight past this point if the heap has to change */
+    if (!mPreviewCbHeap || mPreviewCbFrameSize != size) {
+        if (mPreviewCbHeap)
+            mPreviewCbHeap->release(mPreviewCbHeap);
+
+        mPreviewCbHeap = mGetMemoryCb(-1, size, kBufferCount, 0);
+        if (!mPreviewCbHeap || !mPreviewCbHeap->data) {
+            LOGE("ERR(%s):Fail to allocate the preview callback heap", __func__);
+            if (mPreviewCbHeap)
+                mPreviewCbHeap->release(mPreviewCbHeap);
+            mPreviewCbHeap = 0;
+            mPreviewCbFrameSize = 0;
+            return;
+        }
+        mPreviewCbFrameSize = size;
+        mPreviewCbIndex = 0;
+    }
+
+    dst = (uint8_t *)mPreviewCbHeap->data + size * mPreviewCbIndex;
+    if (format == HAL_PIXEL_FORMAT_YV12)
+        yuyv_to_yv12(frame, dst, width, height);
+    else
+        yuyv_to_nv21(frame, dst, width, height);
+
+    mCallbackLock.lock();
+    mCallbackQueue[(mCallbackHead + mCallbackCount) % kBufferCount] = mPreviewCbIndex;
+    mCallbackCount++;
+    mCallbackInFlight++;
+    mCallbackCondition.signal();
+    mCallbackLock.unlock();
+
+    mPreviewCbIndex = (mPreviewCbIndex + 1) % kBufferCount;
+}
+
+int CameraHardwareSam::callbackThread()
+{
+    int slot;
+
+    mCallbackLock.lock();
+    while (mCallbackCount == 0 && !mExitCallbackThread)
+        mCallbackCondition.wait(mCallbackLock);
+
+    if (mExitCallbackThread) {
+        mCallbackLock.unlock();
+        return NO_ERROR;
+    }
+
+    slot = mCallbackQueue[mCallbackHead];
+    mCallbackHead = (mCallbackHead + 1) % kBufferCount;
+    mCallbackCount--;
+    mCallbackLock.unlock();
+
+    if (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) {
+        CAMERA_TRACE_BEGIN("dataCb");
+        mDataCb(CAMERA_MSG_PREVIEW_FRAME, mPreviewCbHeap, slot, NULL, mCallbackCookie);
+        CAMERA_TRACE_END();
+    }
+
+    mCallbackLock.lock();
+    mCallbackInFlight--;
+    mCallbackDoneCondition.broadcast();
+    mCallbackLock.unlock();
+
     return NO_ERROR;
 }
 
+/* Drop what's queued and wait for the frame being delivered, so no
+ * preview callback lands after stopPreview() returns.
+ */
+void CameraHardwareSam::flushCallbacks()
+{
+    Mutex::Autolock lock(mCallbackLock);
+
+    mCallbackInFlight -= mCallbackCount;
+    mCallbackHead = 0;
+    mCallbackCount = 0;
+    while (mCallbackInFlight > 0)
+        mCallbackDoneCondition.wait(mCallbackLock);
+}
+
+/* Runs on the thread itself, before its first loop.
+ *   camera.sched.<name>     "fifo:<prio>", "rr:<prio>" or "nice:<level>"
+ *   camera.affinity.<name>  cpu mask, e.g. "0x2"
+ * Unset properties leave the thread as created.
+ */
+void CameraHardwareSam::applyThreadSched(int which)
+{
+    CameraThreadSched *sched = &mThreadSched[which];
+    const char *name = kThreadNames[which];
+    char key[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+    struct sched_param param;
+    unsigned long mask;
+    int level;
+
+    snprintf(key, sizeof(key), "camera.sched.%s", name);
+    if (property_get(key, value, NULL) > 0) {
+        if (sscanf(value, "fifo:%d", &level) == 1 ||
+                sscanf(value, "rr:%d", &level) == 1) {
+            param.sched_priority = level;
+            if (sched_setscheduler(0, value[0] == 'f' ? SCHED_FIFO : SCHED_RR,
+                                   &param) < 0)
+                LOGE("ERR(%s):%s thread: %s=%s failed (%s)", __func__,
+                     name, key, value, strerror(errno));
+        } else if (sscanf(value, "nice:%d", &level) == 1) {
+            if (setpriority(PRIO_PROCESS, 0, level) < 0)
+                LOGE("ERR(%s):%s thread: %s=%s failed (%s)", __func__,
+                     name, key, value, strerror(errno));
+        } else
+            LOGE("ERR(%s):bad %s '%s'", __func__, key, value);
+    }
+
+    snprintf(key, sizeof(key), "camera.affinity.%s", name);
+    if (property_get(key, value, NULL) > 0) {
+        mask = strtoul(value, NULL, 0);
+        if (mask == 0 ||
+                syscall(__NR_sched_setaffinity, 0, sizeof(mask), &mask) < 0)
+            LOGE("ERR(%s):%s thread: %s=%s failed", __func__, name, key, value);
+    }
+
+    /* report what the thread actually got */
+    sched->tid = gettid();
+    sched->policy = sched_getscheduler(0);
+    if (sched->policy == SCHED_FIFO || sched->policy == SCHED_RR) {
+        sched_getparam(0, &param);
+        sched->priority = param.sched_priority;
+    } else
+        sched->priority = getpriority(PRIO_PROCESS, 0);
+    mask = 0;
+    if (syscall(__NR_sched_getaffinity, 0, sizeof(mask), &mask) < 0)
+        mask = 0;
+    sched->cpus = mask;
+
+    LOGI("%s : %s thread %d policy %d priority %d cpus 0x%lx", __func__,
+         name, sched->tid, sched->policy, sched->priority, sched->cpus);
+}
+
 void CameraHardwareSam::setSkipFrame(int frame)
 {
     Mutex::Autolock lock(mSkipFrameLock);
@@ -381,6 +813,10 @@ status_t CameraHardwareSam::startPreviewInternal()
     }
 
     setSkipFrame(INITIAL_SKIP_FRAME);
+    mSkipFrameLock.lock();
+    mAeSkipFrame = mV4L2Camera->autoExposureEnabled() ?
+        AE_SKIP_FRAME - INITIAL_SKIP_FRAME : 0;
+    mSkipFrameLock.unlock();
 
     int width, height, frame_size;
 
@@ -391,16 +827,65 @@ status_t CameraHardwareSam::startPreviewInternal()
         mPreviewHeap = 0;
     }
 
+    mBufferCount = mV4L2Camera->getBufferCount();
     mPreviewHeap = mGetMemoryCb((int)mV4L2Camera->getCameraFd(),
                                 frame_size,
-                                kBufferCount,
+                                mBufferCount,
                                 0); // no cookie
+    mAdaptFrames = 0;
+    mAdaptDropped = mV4L2Camera->getDroppedFrames();
 
     mV4L2Camera->getPostViewConfig(&mPostViewWidth, &mPostViewHeight, &mPostViewSize);
 
     return NO_ERROR;
 }
 
+/* Called with mPreviewLock held, from the preview thread. The new size
+ * was validated by setParameters(), so only the buffer swap is left.
+ */
+status_t CameraHardwareSam::switchPreviewInternal()
+{
+    int width, height, frame_size;
+
+    LOGI("%s : switching preview to %dx%d", __func__,
+         mPendingPreviewWidth, mPendingPreviewHeight);
+
+    /* the driver won't reallocate buffers that are still mapped */
+    if (mPreviewHeap) {
+        mPreviewHeap->release(mPreviewHeap);
+        mPreviewHeap = 0;
+    }
+
+    if (mV4L2Camera->switchPreview(mPendingPreviewWidth, mPendingPreviewHeight,
+                                   mPendingPreviewFormat) < 0) {
+        LOGE("ERR(%s):Fail on mV4L2Camera->switchPreview(), restarting", __func__);
+        mV4L2Camera->stopPreview();
+        status_t ret = startPreviewInternal();
+        /* the window buffers must match the size the restart got,
+         * previewThread copies whole frames into them */
+        if (ret == NO_ERROR && mPreviewWindow) {
+            mV4L2Camera->getPreviewSize(&width, &height, &frame_size);
+            ret = configurePreviewWindow(mPreviewWindow, width, height);
+        }
+        return ret;
+    }
+
+    mV4L2Camera->getPreviewSize(&width, &height, &frame_size);
+
+    mBufferCount = mV4L2Camera->getBufferCount();
+    mPreviewHeap = mGetMemoryCb((int)mV4L2Camera->getCameraFd(),
+                                frame_size,
+                                mBufferCount,
+                                0); // no cookie
+    mAdaptFrames = 0;
+    mAdaptDropped = mV4L2Camera->getDroppedFrames();
+
+    if (mPreviewWindow)
+        return configurePreviewWindow(mPreviewWindow, width, height);
+
+    return NO_ERROR;
+}
+
 void CameraHardwareSam::stopPreviewInternal()
 {
     LOGV("%s :", __func__);
@@ -417,6 +902,36 @@ void CameraHardwareSam::stopPreviewInternal()
             LOGV("%s : preview running but deferred, doing nothing", __func__);
     } else
         LOGI("%s : preview not running, doing nothing", __func__);
+
+    flushCallbacks();
+
+    /* a switch that didn't happen yet applies to the next start */
+    if (mPreviewSwitchPending) {
+        mPreviewSwitchPending = false;
+        mV4L2Camera->setPreviewSize(mPendingPreviewWidth, mPendingPreviewHeight,
+                                    mPendingPreviewFormat);
+    }
+}
+
+/* Idle: the size is applied right away. Streaming: the preview thread
+ * swaps buffers between two frames instead of a full stop/start.
+ */
+status_t CameraHardwareSam::setPreviewGeometry(int width, int height, int v4lformat)
+{
+    Mutex::Autolock lock(mPreviewLock);
+
+    if (mPreviewRunning && !mPreviewStartDeferred) {
+        mPendingPreviewWidth  = width;
+        mPendingPreviewHeight = height;
+        mPendingPreviewFormat = v4lformat;
+        mPreviewSwitchPending = true;
+        return NO_ERROR;
+    }
+
+    if (mV4L2Camera->setPreviewSize(width, height, v4lformat) < 0)
+        return UNKNOWN_ERROR;
+
+    return NO_ERROR;
 }
 
 void CameraHardwareSam::stopPreview() {
@@ -463,13 +978,141 @@ int CameraHardwareSam::autoFocusThread()
     }
     mFocusLock.unlock();
 
+    bool focused = true;
+    if (mFocusSupported && mV4L2Camera->getFocusMode() == FOCUS_MODE_AUTO) {
+        mFocusStatsLock.lock();
+        mFocusCancelled = false;
+        mFocusStatsLock.unlock();
+
+        status_t ret = runAutoFocus();
+        if (ret == INVALID_OPERATION) {
+            LOGV("%s : cancelled", __func__);
+            return NO_ERROR;
+        }
+        focused = (ret == NO_ERROR);
+    }
+
     if (mMsgEnabled & CAMERA_MSG_FOCUS)
-        mNotifyCb(CAMERA_MSG_FOCUS, true, 0, mCallbackCookie);
+        mNotifyCb(CAMERA_MSG_FOCUS, focused, 0, mCallbackCookie);
 
     LOGV("%s : exiting with no error", __func__);
     return NO_ERROR;
 }
 
+void CameraHardwareSam::updateFocusStats(const uint8_t *frame, int width, int height)
+{
+    uint32_t sharpness = yuyv_sharpness(frame, width, height);
+
+    Mutex::Autolock lock(mFocusStatsLock);
+    mFocusSharpness = sharpness;
+    mFocusFrameCount++;
+    mFocusStatsCondition.broadcast();
+}
+
+/* Move the lens and return the sharpness of the first frame exposed
+ * entirely at the new position. INVALID_OPERATION means cancelled.
+ */
+status_t CameraHardwareSam::measureFocus(int position, uint32_t *sharpness)
+{
+    if (mV4L2Camera->setControl(V4L2_CID_FOCUS_ABSOLUTE, position) < 0)
+        return UNKNOWN_ERROR;
+
+    Mutex::Autolock lock(mFocusStatsLock);
+    uint32_t target = mFocusFrameCount + AF_SETTLE_FRAMES + 1;
+
+    while ((int32_t)(mFocusFrameCount - target) < 0) {
+        if (mFocusCancelled)
+            return INVALID_OPERATION;
+        if (mFocusStatsCondition.waitRelative(mFocusStatsLock, AF_FRAME_TIMEOUT) != NO_ERROR) {
+            LOGE("ERR(%s):no preview frame, is preview running?", __func__);
+            return TIMED_OUT;
+        }
+    }
+    if (mFocusCancelled)
+        return INVALID_OPERATION;
+
+    *sharpness = mFocusSharpness;
+    return NO_ERROR;
+}
+
+/* Hill climb on V4L2_CID_FOCUS_ABSOLUTE: move the lens by a coarse step
+ * until the sharpness drops twice in a row, then go back over the peak
+ * with a step four times finer, down to the driver's own step.
+ */
+status_t CameraHardwareSam::runAutoFocus()
+{
+    int min, max, step, pos;
+    uint32_t value, best;
+    status_t ret;
+
+    if (mV4L2Camera->getControlRange(V4L2_CID_FOCUS_ABSOLUTE, &min, &max, &step) < 0)
+        return UNKNOWN_ERROR;
+    if (mV4L2Camera->getControl(V4L2_CID_FOCUS_ABSOLUTE, &pos) < 0)
+        pos = min;
+
+    int move = ((max - min) / AF_COARSE_STEPS / step) * step;
+    if (move < step)
+        move = step;
+    int dir = (pos + move > max) ? -1 : 1;
+    int start_pos = pos;
+    int best_pos = pos;
+    int drops = 0;
+    bool turned = false;
+
+    ret = measureFocus(pos, &best);
+    if (ret != NO_ERROR)
+        return ret;
+
+    for (int i = 0; i < AF_MAX_MOVES; i++) {
+        int next = pos + dir * move;
+
+        if (next < min)
+            next = min;
+        if (next > max)
+            next = max;
+
+        if (next == pos) {
+            /* end of the range, nothing more to find this way */
+            drops = AF_MAX_DROPS;
+        } else {
+            ret = measureFocus(next, &value);
+            if (ret != NO_ERROR)
+                return ret;
+            pos = next;
+            if (value > best) {
+                best = value;
+                best_pos = pos;
+                drops = 0;
+            } else
+                drops++;
+        }
+
+        if (drops < AF_MAX_DROPS)
+            continue;
+
+        /* went the wrong way from the start: turn around at full step */
+        if (best_pos == start_pos && !turned) {
+            turned = true;
+        } else {
+            if (move <= step)
+                break;
+            move = ((move / 4) / step) * step;
+            if (move < step)
+                move = step;
+        }
+        dir = -dir;
+        pos = best_pos;
+        drops = 0;
+    }
+
+    LOGD("%s : focus position %d (sharpness %u)", __func__, best_pos, best);
+
+    if (mV4L2Camera->setControl(V4L2_CID_FOCUS_ABSOLUTE, best_pos) < 0)
+        return UNKNOWN_ERROR;
+
+    return NO_ERROR;
+}
+
 status_t CameraHardwareSam::autoFocus()
 {
     LOGV("%s :", __func__);
@@ -487,6 +1130,10 @@ status_t CameraHardwareSam::cancelAutoFocus()
     // the case.
     if (mPreviewRunning && mPreviewStartDeferred) return NO_ERROR;
 
+    Mutex::Autolock lock(mFocusStatsLock);
+    mFocusCancelled = true;
+    mFocusStatsCondition.broadcast();
+
     return NO_ERROR;
 }
 
@@ -496,17 +1143,52 @@ status_t CameraHardwareSam::dump(int fd) const
     char buffer[SIZE];
     String8 result;
     const Vector<String16> args;
+
+    int width, height, frame_size, page_size;
+
+    page_size = getpagesize();
+    mV4L2Camera->getPreviewSize(&width, &height, &frame_size);
+    frame_size = (frame_size + page_size - 1) & ~(page_size - 1);
+    result.append("CameraHardwareSam buffers:\n");
+    snprintf(buffer, SIZE, "  capture  %d x %d bytes = %d kB, %d frames dropped%s\n",
+             mBufferCount, frame_size, mBufferCount * frame_size / 1024,
+             mV4L2Camera->getDroppedFrames(), mBufferAdaptive ? ", adaptive" : "");
+    result.append(buffer);
+    snprintf(buffer, SIZE, "  callback %d x %d bytes = %d kB\n",
+             mPreviewCbHeap ? kBufferCount : 0, mPreviewCbFrameSize,
+             mPreviewCbHeap ? kBufferCount * mPreviewCbFrameSize / 1024 : 0);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "  raw      %d kB\n",
+             mRawHeap ? (int)(mRawHeap->size / 1024) : 0);
+    result.append(buffer);
+
+    result.append("CameraHardwareSam threads:\n");
+    for (int i = 0; i < CAMERA_THREAD_MAX; i++) {
+        const CameraThreadSched *sched = &mThreadSched[i];
+        const char *policy = "other";
+
+        if (sched->policy == SCHED_FIFO)
+            policy = "fifo";
+        else if (sched->policy == SCHED_RR)
+            policy = "rr";
+
+        if (sched->tid == 0)
+            snprintf(buffer, SIZE, "  %-8s not started\n", kThreadNames[i]);
+        else
+            snprintf(buffer, SIZE, "  %-8s tid %d %s %d cpus 0x%lx\n",
+                     kThreadNames[i], sched->tid, policy, sched->priority,
+                     sched->cpus);
+        result.append(buffer);
+    }
     write(fd, result.string(), result.size());
     return NO_ERROR;
 }
 
 status_t CameraHardwareSam::storeMetaDataInBuffers(bool enable)
 {
-    // FIXME:
-    // metadata buffer mode can be turned on or off.
-    // Samsung needs to fix this.
-    if (!enable) {
-        LOGE("Non-metadata buffer mode is not supported!");
+    /* video frames are real YV12 data, not buffer handles */
+    if (enable) {
+        LOGE("Metadata buffer mode is not supported!");
         return INVALID_OPERATION;
     }
     return OK;
@@ -515,8 +1197,6 @@ status_t CameraHardwareSam::storeMetaDataInBuffers(bool enable)
 
 status_t CameraHardwareSam::setPreviewWindow(preview_stream_ops *w)
 {
-    int min_bufs;
-
     mPreviewWindow = w;
     LOGD("%s: mPreviewWindow %p", __func__, mPreviewWindow);
 
@@ -532,6 +1212,33 @@ status_t CameraHardwareSam::setPreviewWindow(preview_stream_ops *w)
         stopPreviewInternal();
     }
 
+    int preview_width;
+    int preview_height;
+    mParameters.getPreviewSize(&preview_width, &preview_height);
+
+    if (configurePreviewWindow(w, preview_width, preview_height) != OK) {
+        mPreviewLock.unlock();
+        return INVALID_OPERATION;
+    }
+
+    if (mPreviewRunning && mPreviewStartDeferred) {
+        LOGD("start/resume preview");
+        status_t ret = startPreviewInternal(); //startPreview();
+        if (ret == OK) {
+            mPreviewStartDeferred = false;
+            mPreviewCondition.signal();
+        }
+    }
+    mPreviewLock.unlock();
+
+    return OK;
+}
+
+status_t CameraHardwareSam::configurePreviewWindow(preview_stream_ops *w,
+                                                   int preview_width, int preview_height)
+{
+    int min_bufs;
+
     if (w->get_min_undequeued_buffer_count(w, &min_bufs)) {
         LOGE("%s: could not retrieve min undequeued buffer count", __func__);
         return INVALID_OPERATION;
@@ -548,14 +1255,13 @@ status_t CameraHardwareSam::setPreviewWindow(preview_stream_ops *w)
         return INVALID_OPERATION;
     }
 
-    int preview_width;
-    int preview_height;
-    mParameters.getPreviewSize(&preview_width, &preview_height);
     int hal_pixel_format = HAL_PIXEL_FORMAT_YCbCr_422_I;
 
     const char *str_preview_format = mParameters.getPreviewFormat();
 
-    if (w->set_usage(w, GRALLOC_USAGE_SW_WRITE_OFTEN)) {
+    /* gralloc falls back to ordinary buffers when its pool is full */
+    if (w->set_usage(w, GRALLOC_USAGE_SW_WRITE_OFTEN |
+                        (mPreviewOverlay ? PREVIEW_USAGE_OVERLAY : 0))) {
         LOGE("%s: could not set usage on gralloc buffer", __func__);
         return INVALID_OPERATION;
     }
@@ -567,20 +1273,10 @@ status_t CameraHardwareSam::setPreviewWindow(preview_stream_ops *w)
              __func__, str_preview_format);
         return INVALID_OPERATION;
     }
-    if (mPreviewRunning && mPreviewStartDeferred) {
-        LOGD("start/resume preview");
-        status_t ret = startPreviewInternal(); //startPreview();
-        if (ret == OK) {
-            mPreviewStartDeferred = false;
-            mPreviewCondition.signal();
-        }
-    }
-    mPreviewLock.unlock();
 
     return OK;
 }
 
-
 status_t CameraHardwareSam::sendCommand(int32_t command, int32_t arg1,
                                         int32_t arg2) {
     return NO_ERROR;
@@ -590,14 +1286,50 @@ status_t CameraHardwareSam::sendCommand(int32_t command, int32_t arg1,
 
 status_t CameraHardwareSam::startRecording()
 {
+    int width, height, frame_size;
+
     LOGD("%s :", __func__);
 
+    Mutex::Autolock lock(mRecordLock);
+
+    if (mRecordRunning)
+        return NO_ERROR;
+
+    mV4L2Camera->getPreviewSize(&width, &height, &frame_size);
+    mRecordFrameSize = yv12_frame_size(width, height);
+
+    if (mRecordHeap)
+        mRecordHeap->release(mRecordHeap);
+    mRecordHeap = mGetMemoryCb(-1, mRecordFrameSize, kBufferCountForRecord, 0);
+    if (!mRecordHeap || !mRecordHeap->data) {
+        LOGE("ERR(%s):Fail to allocate the record heap", __func__);
+        if (mRecordHeap)
+            mRecordHeap->release(mRecordHeap);
+        mRecordHeap = 0;
+        return NO_MEMORY;
+    }
+
+    for (int i = 0; i < kBufferCountForRecord; i++)
+        mRecordBusy[i] = false;
+    mRecordRunning = true;
+
     return NO_ERROR;
 }
 
 void CameraHardwareSam::stopRecording()
 {
     LOGD("%s :", __func__);
+
+    Mutex::Autolock lock(mRecordLock);
+
+    mRecordRunning = false;
+    /* the frame in flight still points into the heap */
+    while (mRecordSending)
+        mRecordCondition.wait(mRecordLock);
+    if (mRecordHeap) {
+        mRecordHeap->release(mRecordHeap);
+        mRecordHeap = 0;
+    }
 }
 
 bool CameraHardwareSam::recordingEnabled()
@@ -609,8 +1341,18 @@ bool CameraHardwareSam::recordingEnabled()
 
 void CameraHardwareSam::releaseRecordingFrame(const void *opaque)
 {
-    struct addrs *addrs = (struct addrs *)opaque;
-    mV4L2Camera->releaseRecordFrame(addrs->buf_index);
+    Mutex::Autolock lock(mRecordLock);
+
+    if (!mRecordHeap || !mRecordFrameSize)
+        return;
+
+    int slot = ((const uint8_t *)opaque - (const uint8_t *)mRecordHeap->data) /
+               mRecordFrameSize;
+    if (slot < 0 || slot >= kBufferCountForRecord) {
+        LOGE("ERR(%s):Unknown frame %p", __func__, opaque);
+        return;
+    }
+    mRecordBusy[slot] = false;
 }
 
 int CameraHardwareSam::pictureThread()
@@ -624,13 +1366,23 @@ int CameraHardwareSam::pictureThread()
     mV4L2Camera->getSnapshotSize(&cap_width, &cap_height, &cap_frame_size);
     int mJpegHeapSize = cap_frame_size;
 
-    if (mRawHeap) {
+    /* kept across shots of the same size */
+    if (mRawHeap && mRawHeap->size != (size_t)mJpegHeapSize) {
         mRawHeap->release(mRawHeap);
         mRawHeap = 0;
     }
-    mRawHeap = mGetMemoryCb(-1, mJpegHeapSize, 1, 0);
+    if (!mRawHeap)
+        mRawHeap = mGetMemoryCb(-1, mJpegHeapSize, 1, 0);
+
+    camera_memory_t *JpegHeap = mRawHeap ? mGetMemoryCb(-1, mJpegHeapSize, 1, 0) : NULL;
 
-    camera_memory_t *JpegHeap = mGetMemoryCb(-1, mJpegHeapSize, 1, 0);
+    if (!mRawHeap || !JpegHeap) {
+        LOGE("%s: no memory for a %d byte picture", __func__, mJpegHeapSize);
+        if (mMsgEnabled & CAMERA_MSG_ERROR)
+            mNotifyCb(CAMERA_MSG_ERROR, CAMERA_ERROR_UNKNOWN, 0, mCallbackCookie);
+        ret = UNKNOWN_ERROR;
+        goto done;
+    }
 
     ret = mV4L2Camera->startSnapshot(mRawHeap->data);
     if(ret != 0) {
@@ -642,7 +1394,9 @@ int CameraHardwareSam::pictureThread()
         mNotifyCb(CAMERA_MSG_SHUTTER, 0, 0, mCallbackCookie);
 
     if (mMsgEnabled & CAMERA_MSG_RAW_IMAGE) {
+        CAMERA_TRACE_BEGIN("dataCb raw");
         mDataCb(CAMERA_MSG_RAW_IMAGE, mRawHeap, 0, NULL, mCallbackCookie);
+        CAMERA_TRACE_END();
     }
 
     mV4L2Camera->SavePicture();
@@ -655,7 +1409,9 @@ int CameraHardwareSam::pictureThread()
     }
 
     if (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) {
+        CAMERA_TRACE_BEGIN("dataCb jpeg");
         mDataCb(CAMERA_MSG_COMPRESSED_IMAGE, JpegHeap, 0, NULL, mCallbackCookie);
+        CAMERA_TRACE_END();
     }
 
     ret = NO_ERROR;
@@ -663,6 +1419,7 @@ int CameraHardwareSam::pictureThread()
 out:
     JpegHeap->release(JpegHeap);
     mV4L2Camera->stopSnapshot();
+done:
     mCaptureLock.lock();
     mCaptureInProgress = false;
     mCaptureCondition.broadcast();
@@ -714,11 +1471,14 @@ status_t CameraHardwareSam::cancelPicture()
     return NO_ERROR;
 }
 
-status_t CameraHardwareSam::setParameters(const CameraParameters& params) {
-    LOGD("%s :", __func__);
-
+status_t CameraHardwareSam::parseParameters(const CameraParameters& params,
+                                            CameraConfig *config) const
+{
     status_t ret = NO_ERROR;
 
+    /* anything missing or invalid keeps its active value */
+    *config = mConfig;
+
     // preview size
     int new_preview_width  = 0;
     int new_preview_height = 0;
@@ -727,19 +1487,25 @@ status_t CameraHardwareSam::setParameters(const CameraParameters& params) {
 
     if (0 < new_preview_width && 0 < new_preview_height &&
             new_str_preview_format != NULL ) {
-        int new_preview_format = 0;
+        int cb_format = -1;
+
         if (!strcmp(new_str_preview_format,
                     CameraParameters::PIXEL_FORMAT_YUV420SP))
-            new_preview_format = V4L2_PIX_FMT_YUYV;
-        else
+            cb_format = HAL_PIXEL_FORMAT_YCrCb_420_SP;
+        else if (!strcmp(new_str_preview_format,
+                         CameraParameters::PIXEL_FORMAT_YUV420P))
+            cb_format = HAL_PIXEL_FORMAT_YV12;
+        else if (!strcmp(new_str_preview_format,
+                         CameraParameters::PIXEL_FORMAT_YUV422I))
+            cb_format = HAL_PIXEL_FORMAT_YCbCr_422_I;
+
+        if (cb_format != -1) {
+            config->preview_width     = new_preview_width;
+            config->preview_height    = new_preview_height;
+            config->preview_v4lformat = V4L2_PIX_FMT_YUYV;
+            config->preview_cb_format = cb_format;
+        } else
             LOGE("ERR: not a supported preview format");
-
-        if (mV4L2Camera->setPreviewSize(new_preview_width, new_preview_height, new_preview_format) < 0) {
-            ret = UNKNOWN_ERROR;
-        } else {
-            mParameters.setPreviewSize(new_preview_width, new_preview_height);
-            mParameters.setPreviewFormat(new_str_preview_format);
-        }
     } else {
         LOGE("%s: Invalid preview size(%dx%d)",
              __func__, new_preview_width, new_preview_height);
@@ -747,82 +1513,203 @@ status_t CameraHardwareSam::setParameters(const CameraParameters& params) {
         ret = INVALID_OPERATION;
     }
 
+    // picture size
     int new_picture_width  = 0;
     int new_picture_height = 0;
 
     params.getPictureSize(&new_picture_width, &new_picture_height);
     if (0 < new_picture_width && 0 < new_picture_height) {
-        if (mV4L2Camera->setSnapshotSize(new_picture_width, new_picture_height) < 0) {
-            LOGE("ERR(%s):Fail on mV4L2Camera->setSnapshotSize(width(%d), height(%d))",
-                 __func__, new_picture_width, new_picture_height);
-            ret = UNKNOWN_ERROR;
-        } else {
-            mParameters.setPictureSize(new_picture_width, new_picture_height);
-        }
+        config->picture_width  = new_picture_width;
+        config->picture_height = new_picture_height;
     }
 
     // picture format
     const char *new_str_picture_format = params.getPictureFormat();
-    LOGD("%s : new_str_picture_format %s", __func__, new_str_picture_format);
     if (new_str_picture_format != NULL) {
-        int new_picture_format = 0;
         if (!strcmp(new_str_picture_format, CameraParameters::PIXEL_FORMAT_RGB565))
-            new_picture_format = V4L2_PIX_FMT_RGB565;
+            config->picture_v4lformat = V4L2_PIX_FMT_RGB565;
         else if (!strcmp(new_str_picture_format, CameraParameters::PIXEL_FORMAT_JPEG))
-            new_picture_format = V4L2_PIX_FMT_YUYV;
+            config->picture_v4lformat = V4L2_PIX_FMT_YUYV;
         else
             LOGE("ERR: not a supported picture format");
+    }
 
-        if (mV4L2Camera->setSnapshotPixelFormat(new_picture_format) < 0) {
-            LOGE("ERR(%s):Fail on mV4L2Camera->setSnapshotPixelFormat(format(%d))", __func__, new_picture_format);
-            ret = UNKNOWN_ERROR;
-        } else {
-            mParameters.setPictureFormat(new_str_picture_format);
+    // frame rate
+    config->frame_rate = params.getPreviewFrameRate();
+
+    // rotation
+    int new_rotation = params.getInt(CameraParameters::KEY_ROTATION);
+    if (0 <= new_rotation)
+        config->rotation = new_rotation;
+
+    // white balance
+    const char *new_white_str = params.get(CameraParameters::KEY_WHITE_BALANCE);
+    if (new_white_str != NULL) {
+        if (!strcmp(new_white_str, CameraParameters::WHITE_BALANCE_AUTO))
+            config->white_balance = WHITE_BALANCE_AUTO;
+        else if (!strcmp(new_white_str, CameraParameters::WHITE_BALANCE_INCANDESCENT))
+            config->white_balance = WHITE_BALANCE_INCANDESCENT;
+        else if (!strcmp(new_white_str, CameraParameters::WHITE_BALANCE_FLUORESCENT))
+            config->white_balance = WHITE_BALANCE_FLUORESCENT;
+        else if (!strcmp(new_white_str, CameraParameters::WHITE_BALANCE_DAYLIGHT))
+            config->white_balance = WHITE_BALANCE_DAYLIGHT;
+        else if (!strcmp(new_white_str, CameraParameters::WHITE_BALANCE_CLOUDY_DAYLIGHT))
+            config->white_balance = WHITE_BALANCE_CLOUDY_DAYLIGHT;
+        else {
+            LOGE("%s::unmatched white_balance(%s)", __func__, new_white_str);
+            ret = BAD_VALUE;
         }
     }
 
-    // frame rate
-    int new_frame_rate = params.getPreviewFrameRate();
-    if (new_frame_rate != mParameters.getPreviewFrameRate()) {
-        mParameters.setPreviewFrameRate(new_frame_rate);
+    // focus mode
+    const char *new_focus_mode_str = params.get(CameraParameters::KEY_FOCUS_MODE);
+    if (new_focus_mode_str != NULL) {
+        if (!strcmp(new_focus_mode_str,
+                    CameraParameters::FOCUS_MODE_AUTO))
+            config->focus_mode = FOCUS_MODE_AUTO;
+        else if (!strcmp(new_focus_mode_str,
+                         CameraParameters::FOCUS_MODE_FIXED))
+            config->focus_mode = FOCUS_MODE_FIXED;
+        else
+            LOGE("%s::unmatched focus_mode(%s)", __func__, new_focus_mode_str);
     }
 
-    int new_rotation = params.getInt(CameraParameters::KEY_ROTATION);
-    if (0 <= new_rotation) {
-        LOGD("%s : set orientation:%d\n", __func__, new_rotation);
-        if (mV4L2Camera->SetRotate(new_rotation) < 0) {
-            LOGE("ERR(%s):Fail on mV4L2Camera->SetRotate(%d)", __func__, new_rotation);
+    return ret;
+}
+
+int CameraHardwareSam::diffConfig(const CameraConfig& config) const
+{
+    int changed = 0;
+
+    if (!mConfigValid)
+        return CONFIG_ALL;
+
+    if (config.preview_width     != mConfig.preview_width  ||
+        config.preview_height    != mConfig.preview_height ||
+        config.preview_v4lformat != mConfig.preview_v4lformat)
+        changed |= CONFIG_PREVIEW_GEOMETRY;
+
+    if (config.preview_cb_format != mConfig.preview_cb_format)
+        changed |= CONFIG_PREVIEW_FORMAT;
+
+    if (config.picture_width     != mConfig.picture_width  ||
+        config.picture_height    != mConfig.picture_height ||
+        config.picture_v4lformat != mConfig.picture_v4lformat)
+        changed |= CONFIG_PICTURE_GEOMETRY;
+
+    if (config.frame_rate != mConfig.frame_rate)
+        changed |= CONFIG_FRAME_RATE;
+
+    if (config.rotation != mConfig.rotation)
+        changed |= CONFIG_ROTATION;
+
+    if (config.white_balance != mConfig.white_balance)
+        changed |= CONFIG_WHITE_BALANCE;
+
+    if (config.focus_mode != mConfig.focus_mode)
+        changed |= CONFIG_FOCUS_MODE;
+
+    return changed;
+}
+
+status_t CameraHardwareSam::setParameters(const CameraParameters& params) {
+    LOGD("%s :", __func__);
+
+    CameraConfig config;
+    status_t ret = parseParameters(params, &config);
+    int changed = diffConfig(config);
+
+    LOGV("%s : changed 0x%x", __func__, changed);
+
+    if (changed & CONFIG_PREVIEW_GEOMETRY) {
+        if (mV4L2Camera->tryPreviewSize(config.preview_width, config.preview_height,
+                                        config.preview_v4lformat) < 0 ||
+            setPreviewGeometry(config.preview_width, config.preview_height,
+                               config.preview_v4lformat) != NO_ERROR) {
             ret = UNKNOWN_ERROR;
+            changed &= ~CONFIG_PREVIEW_GEOMETRY;
+            config.preview_width     = mConfig.preview_width;
+            config.preview_height    = mConfig.preview_height;
+            config.preview_v4lformat = mConfig.preview_v4lformat;
         } else {
-            mParameters.set(CameraParameters::KEY_ROTATION, new_rotation);
+            mParameters.setPreviewSize(config.preview_width, config.preview_height);
+            mParameters.setPreviewFormat(params.getPreviewFormat());
         }
     }
 
-    const char *new_focus_mode_str = params.get(CameraParameters::KEY_FOCUS_MODE);
+    if (changed & CONFIG_PREVIEW_FORMAT)
+        mParameters.setPreviewFormat(params.getPreviewFormat());
 
-    // focus mode
-    if (new_focus_mode_str != NULL) {
-        int  new_focus_mode = -1;
-        if (!strcmp(new_focus_mode_str,
-                    CameraParameters::FOCUS_MODE_AUTO)) {
+    if (changed & CONFIG_PICTURE_GEOMETRY) {
+        int old_width, old_height, old_size;
+        int old_format = mV4L2Camera->getSnapshotPixelFormat();
+        bool failed = true;
+
+        mV4L2Camera->getSnapshotSize(&old_width, &old_height, &old_size);
+        if (mV4L2Camera->setSnapshotSize(config.picture_width, config.picture_height) < 0)
+            LOGE("ERR(%s):Fail on mV4L2Camera->setSnapshotSize(width(%d), height(%d))",
+                 __func__, config.picture_width, config.picture_height);
+        else if (mV4L2Camera->setSnapshotPixelFormat(config.picture_v4lformat) < 0)
+            LOGE("ERR(%s):Fail on mV4L2Camera->setSnapshotPixelFormat(format(%d))",
+                 __func__, config.picture_v4lformat);
+        else
+            failed = false;
+
+        if (failed) {
+            /* neither half stays, so the same request is tried again */
+            mV4L2Camera->setSnapshotSize(old_width, old_height);
+            mV4L2Camera->setSnapshotPixelFormat(old_format);
+            ret = UNKNOWN_ERROR;
+            config.picture_width     = mConfig.picture_width;
+            config.picture_height    = mConfig.picture_height;
+            config.picture_v4lformat = mConfig.picture_v4lformat;
+        } else {
+            mParameters.setPictureSize(config.picture_width, config.picture_height);
+            mParameters.setPictureFormat(params.getPictureFormat());
         }
-        else if (!strcmp(new_focus_mode_str,
-                         CameraParameters::FOCUS_MODE_FIXED)) {
+    }
+
+    if (changed & CONFIG_FRAME_RATE)
+        mParameters.setPreviewFrameRate(config.frame_rate);
+
+    if (changed & CONFIG_ROTATION) {
+        LOGD("%s : set orientation:%d\n", __func__, config.rotation);
+        if (mV4L2Camera->SetRotate(config.rotation) < 0) {
+            LOGE("ERR(%s):Fail on mV4L2Camera->SetRotate(%d)", __func__, config.rotation);
+            ret = UNKNOWN_ERROR;
+            config.rotation = mConfig.rotation;
+        } else {
+            mParameters.set(CameraParameters::KEY_ROTATION, config.rotation);
         }
-        else {
-            LOGE("%s::unmatched focus_mode(%s)", __func__, new_focus_mode_str);
-            //ret = UNKNOWN_ERROR;
+    }
+
+    if (changed & CONFIG_WHITE_BALANCE) {
+        if (mV4L2Camera->setWhiteBalance(config.white_balance) < 0) {
+            LOGE("ERR(%s):Fail on mV4L2Camera->setWhiteBalance(%d)",
+                 __func__, config.white_balance);
+            ret = UNKNOWN_ERROR;
+            config.white_balance = mConfig.white_balance;
+        } else {
+            mParameters.set(CameraParameters::KEY_WHITE_BALANCE,
+                            params.get(CameraParameters::KEY_WHITE_BALANCE));
         }
-        if (0 <= new_focus_mode) {
-            if (mV4L2Camera/*->setFocusMode(new_focus_mode) < 0*/) {
-                LOGE("%s::mV4L2Camera->setFocusMode(%d) fail", __func__, new_focus_mode);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_FOCUS_MODE, CameraParameters::FOCUS_MODE_FIXED);
-            }
+    }
+
+    /* only kept for autoFocus(), nothing reaches the driver here */
+    if (changed & CONFIG_FOCUS_MODE) {
+        if (mV4L2Camera->setFocusMode(config.focus_mode) < 0) {
+            LOGE("%s::mV4L2Camera->setFocusMode(%d) fail", __func__, config.focus_mode);
+            ret = UNKNOWN_ERROR;
+            config.focus_mode = mConfig.focus_mode;
+        } else {
+            mParameters.set(CameraParameters::KEY_FOCUS_MODE,
+                            params.get(CameraParameters::KEY_FOCUS_MODE));
         }
     }
 
+    mConfig = config;
+    mConfigValid = true;
+
     return ret;
 }
 
@@ -853,10 +1740,25 @@ void CameraHardwareSam::release()
         mPreviewThread->requestExitAndWait();
         mPreviewThread.clear();
     }
+    if (mCallbackThread != NULL) {
+        flushCallbacks();
+        mCallbackLock.lock();
+        mCallbackThread->requestExit();
+        mExitCallbackThread = true;
+        mCallbackCondition.signal();
+        mCallbackLock.unlock();
+        mCallbackThread->requestExitAndWait();
+        mCallbackThread.clear();
+    }
     if (mAutoFocusThread != NULL) {
         /* this thread is normally already in it's threadLoop but blocked
          * on the condition variable.  signal it so it wakes up and can exit.
          */
+        mFocusStatsLock.lock();
+        mFocusCancelled = true;
+        mFocusStatsCondition.broadcast();
+        mFocusStatsLock.unlock();
+
         mFocusLock.lock();
         mAutoFocusThread->requestExit();
         mExitAutoFocusThread = true;
@@ -878,58 +1780,33 @@ void CameraHardwareSam::release()
         mPreviewHeap->release(mPreviewHeap);
         mPreviewHeap = 0;
     }
-
-    mV4L2Camera->DeinitCamera();
-
-    mV4L2Camera = NULL;
-}
-
-bool CameraHardwareSam::YUY2toYV12(void *srcBuf, void *dstBuf, uint32_t srcWidth, uint32_t srcHeight)
-{
-    int32_t        x, y, src_y_start_pos, dst_cbcr_pos, dst_pos, src_pos;
-    unsigned char *srcBufPointer = (unsigned char *)srcBuf;
-    unsigned char *dstBufPointer = (unsigned char *)dstBuf;
-
-    dst_pos = 0;
-    dst_cbcr_pos = srcWidth*srcHeight;
-    for (uint32_t y = 0; y < srcHeight; y++) {
-        src_y_start_pos = (y * (srcWidth * 2));
-
-        for (uint32_t x = 0; x < (srcWidth * 2); x += 2) {
-            src_pos = src_y_start_pos + x;
-
-            dstBufPointer[dst_pos++] = srcBufPointer[src_pos];
-        }
+    if (mPreviewCbHeap) {
+        mPreviewCbHeap->release(mPreviewCbHeap);
+        mPreviewCbHeap = 0;
     }
-    for (uint32_t y = 0; y < srcHeight; y += 2) {
-        src_y_start_pos = (y * (srcWidth * 2));
-
-        for (uint32_t x = 0; x < (srcWidth * 2); x += 4) {
-            src_pos = src_y_start_pos + x;
-            dstBufPointer[dst_cbcr_pos++] = srcBufPointer[src_pos + 1];
-        }
+    if (mRecordHeap) {
+        mRecordHeap->release(mRecordHeap);
+        mRecordHeap = 0;
     }
-    for (uint32_t y = 0; y < srcHeight; y += 2) {
-        src_y_start_pos = (y * (srcWidth * 2));
 
-        for (uint32_t x = 0; x < (srcWidth * 2); x += 4) {
-            src_pos = src_y_start_pos + x;
-            dstBufPointer[dst_cbcr_pos++] = srcBufPointer[src_pos + 3];
-        }
+    if (mV4L2Camera) {
+        mV4L2Camera->DeinitCamera();
+        delete mV4L2Camera;
+        mV4L2Camera = NULL;
     }
+}
 
+bool CameraHardwareSam::YUY2toYV12(void *srcBuf, void *dstBuf, uint32_t srcWidth, uint32_t srcHeight)
+{
+    yuyv_to_i420((const uint8_t *)srcBuf, (uint8_t *)dstBuf, srcWidth, srcHeight);
     return true;
 }
-static CameraInfo sCameraInfo[] = {
-    {
-        CAMERA_FACING_BACK,
-        0,  /* orientation */
-    },
-};
 
 /** Close this device */
 
-static camera_device_t *g_cam_device;
+/* one slot per camera id, each with its own V4L2Camera and threads */
+static Mutex g_cam_lock;
+static camera_device_t *g_cam_devices[MAX_CAMERAS];
 
 static int HAL_camera_device_close(struct hw_device_t* device)
 {
@@ -937,8 +1814,12 @@ static int HAL_camera_device_close(struct hw_device_t* device)
     if (device) {
         camera_device_t *cam_device = (camera_device_t *)device;
         delete static_cast<CameraHardwareSam *>(cam_device->priv);
+
+        Mutex::Autolock lock(g_cam_lock);
+        for (int i = 0; i < MAX_CAMERAS; i++)
+            if (g_cam_devices[i] == cam_device)
+                g_cam_devices[i] = 0;
         free(cam_device);
-        g_cam_device = 0;
     }
     return 0;
 }
@@ -1227,13 +2108,18 @@ static int HAL_camera_device_dump(struct camera_device *dev, int fd)
 static int HAL_getNumberOfCameras()
 {
     LOGV("%s", __func__);
-    return sizeof(sCameraInfo) / sizeof(sCameraInfo[0]);
+    return V4L2Camera::getNumberOfCameras();
 }
 
 static int HAL_getCameraInfo(int cameraId, struct camera_info *cameraInfo)
 {
     LOGV("%s", __func__);
-    memcpy(cameraInfo, &sCameraInfo[cameraId], sizeof(CameraInfo));
+    const struct ISI_node *node = V4L2Camera::getCameraNode(cameraId);
+
+    if (!node)
+        return -EINVAL;
+    cameraInfo->facing = node->front ? CAMERA_FACING_FRONT : CAMERA_FACING_BACK;
+    cameraInfo->orientation = node->orientation;
     return 0;
 }
 
@@ -1279,34 +2165,32 @@ static int HAL_camera_device_open(const struct hw_module_t* module,
         return -EINVAL;
     }
 
-    if (g_cam_device) {
-        if (obj(g_cam_device)->getCameraId() == cameraId) {
-            LOGV("returning existing camera ID %s", id);
-            goto done;
-        } else {
-            LOGE("Cannot open camera %d. camera %d is already running!",
-                 cameraId, obj(g_cam_device)->getCameraId());
-            return -ENOSYS;
-        }
+    Mutex::Autolock lock(g_cam_lock);
+    camera_device_t *cam_device = g_cam_devices[cameraId];
+
+    if (cam_device) {
+        LOGV("returning existing camera ID %s", id);
+        goto done;
     }
 
-    g_cam_device = (camera_device_t *)malloc(sizeof(camera_device_t));
-    if (!g_cam_device)
+    cam_device = (camera_device_t *)malloc(sizeof(camera_device_t));
+    if (!cam_device)
         return -ENOMEM;
 
-    g_cam_device->common.tag     = HARDWARE_DEVICE_TAG;
-    g_cam_device->common.version = 1;
-    g_cam_device->common.module  = const_cast<hw_module_t *>(module);
-    g_cam_device->common.close   = HAL_camera_device_close;
+    cam_device->common.tag     = HARDWARE_DEVICE_TAG;
+    cam_device->common.version = 1;
+    cam_device->common.module  = const_cast<hw_module_t *>(module);
+    cam_device->common.close   = HAL_camera_device_close;
 
-    g_cam_device->ops = &camera_device_ops;
+    cam_device->ops = &camera_device_ops;
 
     LOGI("%s: open camera %s", __func__, id);
 
-    g_cam_device->priv = new CameraHardwareSam(cameraId, g_cam_device);
+    cam_device->priv = new CameraHardwareSam(cameraId, cam_device);
+    g_cam_devices[cameraId] = cam_device;
 
 done:
-    *device = (hw_device_t *)g_cam_device;
+    *device = (hw_device_t *)cam_device;
     LOGI("%s: opened camera %s (%p)", __func__, id, *device);
     return 0;
 }
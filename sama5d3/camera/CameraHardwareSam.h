@@ -48,6 +48,52 @@ struct addrs_cap {
     unsigned int height;
 };
 
+/* Typed copy of the parameters the HAL acts on. setParameters() parses
+ * into one of these and diffs it against the active one, so only the
+ * settings that really changed reach the driver.
+ */
+struct CameraConfig {
+    int preview_width;
+    int preview_height;
+    int preview_v4lformat;
+    int preview_cb_format;  /* HAL_PIXEL_FORMAT_* of CAMERA_MSG_PREVIEW_FRAME */
+    int picture_width;
+    int picture_height;
+    int picture_v4lformat;
+    int frame_rate;
+    int rotation;
+    int white_balance;
+    int focus_mode;
+};
+
+enum {
+    CONFIG_PREVIEW_GEOMETRY = 1 << 0,   /* needs a stream restart */
+    CONFIG_PICTURE_GEOMETRY = 1 << 1,   /* picked up by the next snapshot */
+    CONFIG_FRAME_RATE       = 1 << 2,
+    CONFIG_ROTATION         = 1 << 3,
+    CONFIG_WHITE_BALANCE    = 1 << 4,   /* hot, VIDIOC_S_CTRL */
+    CONFIG_FOCUS_MODE       = 1 << 5,   /* hot */
+    CONFIG_PREVIEW_FORMAT   = 1 << 6,   /* callback layout only */
+    CONFIG_ALL              = 0x7f,
+};
+
+/* Camera threads whose scheduling can be tuned with the properties
+ * camera.sched.<name> and camera.affinity.<name>.
+ */
+enum {
+    CAMERA_THREAD_PREVIEW = 0,
+    CAMERA_THREAD_CALLBACK,
+    CAMERA_THREAD_ENCODE,
+    CAMERA_THREAD_MAX,
+};
+
+struct CameraThreadSched {
+    pid_t tid;              /* 0 until the thread first ran */
+    int policy;             /* SCHED_OTHER, SCHED_FIFO or SCHED_RR */
+    int priority;           /* rt priority, or nice level for SCHED_OTHER */
+    unsigned long cpus;     /* affinity mask */
+};
+
 
 class CameraHardwareSam : public virtual RefBase {
 public:
@@ -90,9 +136,13 @@ public:
 private:
     status_t    startPreviewInternal();
     void stopPreviewInternal();
+    status_t    configurePreviewWindow(preview_stream_ops *w, int width, int height);
+    status_t    setPreviewGeometry(int width, int height, int v4lformat);
+    status_t    switchPreviewInternal();
 
-    static  const int   kBufferCount = MAX_BUFFERS;
-    static  const int   kBufferCountForRecord = MAX_BUFFERS;
+    /* display and callback buffers; the capture queue is mBufferCount */
+    static  const int   kBufferCount = DEFAULT_BUFFERS;
+    static  const int   kBufferCountForRecord = DEFAULT_BUFFERS;
 
     class PreviewThread : public Thread {
         CameraHardwareSam *mHardware;
@@ -103,6 +153,10 @@ private:
         virtual void onFirstRef() {
             run("CameraPreviewThread", PRIORITY_URGENT_DISPLAY);
         }
+        virtual status_t readyToRun() {
+            mHardware->applyThreadSched(CAMERA_THREAD_PREVIEW);
+            return NO_ERROR;
+        }
         virtual bool threadLoop() {
             mHardware->previewThreadWrapper();
             return false;
@@ -115,12 +169,36 @@ private:
         PictureThread(CameraHardwareSam *hw):
             Thread(false),
             mHardware(hw) { }
+        virtual status_t readyToRun() {
+            mHardware->applyThreadSched(CAMERA_THREAD_ENCODE);
+            return NO_ERROR;
+        }
         virtual bool threadLoop() {
             mHardware->pictureThread();
             return false;
         }
     };
 
+    /* hands the converted preview frames to the client, so a slow
+     * CAMERA_MSG_PREVIEW_FRAME consumer doesn't hold up capture
+     */
+    class CallbackThread : public Thread {
+        CameraHardwareSam *mHardware;
+    public:
+        CallbackThread(CameraHardwareSam *hw): Thread(false), mHardware(hw) { }
+        virtual void onFirstRef() {
+            run("CameraCallbackThread", PRIORITY_DEFAULT);
+        }
+        virtual status_t readyToRun() {
+            mHardware->applyThreadSched(CAMERA_THREAD_CALLBACK);
+            return NO_ERROR;
+        }
+        virtual bool threadLoop() {
+            mHardware->callbackThread();
+            return true;
+        }
+    };
+
     class AutoFocusThread : public Thread {
         CameraHardwareSam *mHardware;
     public:
@@ -141,6 +219,22 @@ private:
     int         previewThread();
     int         previewThreadWrapper();
 
+    sp<CallbackThread>  mCallbackThread;
+    int         callbackThread();
+    void        flushCallbacks();
+    /* preview callback slots queued or being delivered */
+    mutable Mutex       mCallbackLock;
+    mutable Condition   mCallbackCondition;
+    mutable Condition   mCallbackDoneCondition;
+    int         mCallbackQueue[kBufferCount];
+    int         mCallbackHead;
+    int         mCallbackCount;
+    int         mCallbackInFlight;
+    bool        mExitCallbackThread;
+
+    void        applyThreadSched(int which);
+    CameraThreadSched   mThreadSched[CAMERA_THREAD_MAX];
+
     sp<AutoFocusThread> mAutoFocusThread;
     int         autoFocusThread();
 
@@ -173,16 +267,36 @@ private:
                            int *pdwJPEGSize, void *pVideo,
                            int *pdwVideoSize);
     void        setSkipFrame(int frame);
+    void        sendPreviewFrame(const uint8_t *frame, int index,
+                                 int width, int height);
+    void        sendRecordFrame(const uint8_t *frame, nsecs_t timestamp,
+                                int width, int height);
     bool        isSupportedPreviewSize(const int width,
                                        const int height) const;
     bool        isSupportedParameter(const char * const parm,
                                      const char * const supported_parm) const;
+    status_t    parseParameters(const CameraParameters& params,
+                                CameraConfig *config) const;
+    int         diffConfig(const CameraConfig& config) const;
     status_t    waitCaptureCompletion();
     /* used by auto focus thread to block until it's told to run */
     mutable Mutex       mFocusLock;
     mutable Condition   mFocusCondition;
     bool        mExitAutoFocusThread;
 
+    /* contrast autofocus: the preview thread publishes the sharpness of
+     * every frame, the auto focus thread climbs towards its peak.
+     */
+    status_t    runAutoFocus();
+    status_t    measureFocus(int position, uint32_t *sharpness);
+    void        updateFocusStats(const uint8_t *frame, int width, int height);
+    mutable Mutex       mFocusStatsLock;
+    mutable Condition   mFocusStatsCondition;
+    uint32_t    mFocusSharpness;
+    uint32_t    mFocusFrameCount;
+    bool        mFocusCancelled;
+    bool        mFocusSupported;
+
     /* used by preview thread to block until it's told to run */
     mutable Mutex       mPreviewLock;
     mutable Condition   mPreviewCondition;
@@ -190,6 +304,11 @@ private:
     bool        mPreviewRunning;
     bool        mPreviewStartDeferred;
     bool        mExitPreviewThread;
+    /* resolution switch handed to the preview thread */
+    bool        mPreviewSwitchPending;
+    int         mPendingPreviewWidth;
+    int         mPendingPreviewHeight;
+    int         mPendingPreviewFormat;
 
     preview_stream_ops *mPreviewWindow;
 
@@ -199,16 +318,33 @@ private:
 
     CameraParameters    mParameters;
     CameraParameters    mInternalParameters;
+    CameraConfig        mConfig;
+    bool        mConfigValid;
 
     camera_memory_t     *mPreviewHeap;
+    int         mBufferCount;       /* capture buffers behind mPreviewHeap */
+    /* adaptive capture queue depth */
+    void        adaptBufferCount();
+    bool        mBufferAdaptive;
+    int         mAdaptFrames;
+    int         mAdaptDropped;
+    int         mLowMemoryKb;
+    bool        mPreviewOverlay;    /* window buffers the HEO fetches in place */
+    camera_memory_t     *mPreviewCbHeap;    /* NV21/YV12 callback frames */
+    int         mPreviewCbFrameSize;
+    int         mPreviewCbIndex;
     camera_memory_t     *mRawHeap;
-    camera_memory_t     *mRecordHeap;
+    camera_memory_t     *mRecordHeap;      /* YV12 video frames */
+    int         mRecordFrameSize;
+    bool        mRecordBusy[kBufferCountForRecord];
 
-    V4L2Camera           *mV4L2Camera;
+    V4L2Camera           *mV4L2Camera;     /* ours alone, one per open camera */
+    int         mCameraId;
     const __u8  *mCameraSensorName;
 
     mutable Mutex       mSkipFrameLock;
     int         mSkipFrame;
+    int         mAeSkipFrame;   /* more frames held back until AE settles */
 
     mutable Mutex	    	mStateLock;
     camera_notify_callback     mNotifyCb;
@@ -220,7 +356,9 @@ private:
     int32_t     mMsgEnabled;
 
     bool        mRecordRunning;
+    bool        mRecordSending;     /* a frame is with mDataCbTimestamp */
     mutable Mutex       mRecordLock;
+    Condition   mRecordCondition;
     int         mPostViewWidth;
     int         mPostViewHeight;
     int         mPostViewSize;
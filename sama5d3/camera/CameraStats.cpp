@@ -0,0 +1,112 @@
+/*
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License
+*/
+
+#include <string.h>
+
+#include "CameraStats.h"
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define SHARPNESS_ROW_STEP  4
+#define EXPOSURE_GRID       8
+
+/* |a - b| + |a - c| for one luma sample, b right of a, c below it */
+static inline uint32_t gradient(int a, int b, int c)
+{
+    int dx = a - b;
+    int dy = a - c;
+
+    return (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+}
+
+uint32_t yuyv_sharpness(const uint8_t *frame, int width, int height)
+{
+    int pitch = width * 2;
+    /* centre quarter, x kept even so luma stays at even bytes */
+    int x0 = (width / 4) & ~1;
+    int y0 = height / 4;
+    int roi_width = width / 2;
+    int roi_height = height / 2;
+    uint32_t sum = 0;
+
+    if (width < 8 || height < 8)
+        return 0;
+
+    for (int y = y0; y < y0 + roi_height; y += SHARPNESS_ROW_STEP) {
+        const uint8_t *row = frame + y * pitch + x0 * 2;
+        int x = 0;
+
+#if defined(__ARM_NEON__)
+        /* 16 luma samples per step. Each step adds at most 4 * 255 to a
+         * 16-bit lane, so fold into 32 bits every 32 steps.
+         */
+        uint32x4_t acc32 = vdupq_n_u32(0);
+
+        while (x + 16 <= roi_width) {
+            uint16x8_t acc = vdupq_n_u16(0);
+            int end = x + 16 * 32;
+
+            if (end > roi_width)
+                end = roi_width;
+            for (; x + 16 <= end; x += 16) {
+                const uint8_t *p = row + x * 2;
+                uint8x16_t a = vld2q_u8(p).val[0];
+                uint8x16_t b = vld2q_u8(p + 2).val[0];
+                uint8x16_t c = vld2q_u8(p + pitch).val[0];
+
+                acc = vpadalq_u8(acc, vabdq_u8(a, b));
+                acc = vpadalq_u8(acc, vabdq_u8(a, c));
+            }
+            acc32 = vpadalq_u16(acc32, acc);
+        }
+
+        uint64x2_t acc64 = vpaddlq_u32(acc32);
+        sum += (uint32_t)(vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1));
+#endif
+
+        for (; x < roi_width; x++) {
+            const uint8_t *p = row + x * 2;
+
+            sum += gradient(p[0], p[2], p[pitch]);
+        }
+    }
+
+    return sum;
+}
+
+void yuyv_exposure_stats(const uint8_t *frame, int width, int height,
+                         struct yuyv_stats *stats)
+{
+    int pitch = width * 2;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (int y = EXPOSURE_GRID / 2; y < height; y += EXPOSURE_GRID) {
+        const uint8_t *row = frame + y * pitch;
+
+        /* x stays even: Y0 U Y1 V */
+        for (int x = 0; x + 2 <= width; x += EXPOSURE_GRID) {
+            const uint8_t *p = row + x * 2;
+
+            stats->histogram[p[0] >> 2]++;
+            stats->sum_y += p[0];
+            stats->sum_u += p[1];
+            stats->sum_v += p[3];
+            stats->count++;
+        }
+    }
+}
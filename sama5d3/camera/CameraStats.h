@@ -0,0 +1,50 @@
+/*
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License
+*/
+
+#ifndef ANDROID_HARDWARE_CAMERA_STATS_H
+#define ANDROID_HARDWARE_CAMERA_STATS_H
+
+#include <stdint.h>
+
+/* Image statistics computed on the preview frames. Kept free of any
+ * Android dependency so the kernels can be built and timed on a host.
+ */
+
+/*
+ * Contrast measure for autofocus: sum of absolute horizontal and
+ * vertical luma gradients over the centre quarter of a YUYV frame,
+ * sampled every 4th line. Larger is sharper; only meaningful when
+ * compared between frames of the same size.
+ */
+uint32_t yuyv_sharpness(const uint8_t *frame, int width, int height);
+
+#define LUMA_HISTOGRAM_BINS     64
+
+struct yuyv_stats {
+    uint32_t histogram[LUMA_HISTOGRAM_BINS];    /* luma >> 2 */
+    uint32_t count;
+    uint32_t sum_y;
+    uint32_t sum_u;
+    uint32_t sum_v;
+};
+
+/*
+ * Exposure and grey-world statistics of a YUYV frame, taken from one
+ * macropixel on an 8x8 pixel grid.
+ */
+void yuyv_exposure_stats(const uint8_t *frame, int width, int height,
+                         struct yuyv_stats *stats);
+
+#endif
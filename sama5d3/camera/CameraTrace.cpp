@@ -0,0 +1,83 @@
+/*
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License
+*/
+
+#define LOG_TAG "CameraTrace"
+#include <utils/Log.h>
+#include <cutils/properties.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "CameraTrace.h"
+
+#define TRACE_MARKER_LEN    128
+
+static const char * const kTraceMarkers[] = {
+    "/sys/kernel/debug/tracing/trace_marker",
+    "/sys/kernel/tracing/trace_marker",
+};
+
+int camera_trace_fd = -1;
+
+/* Called when the HAL is opened, before any of its threads run. The
+ * marker file stays open for the life of the process once enabled.
+ */
+void camera_trace_init(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get("camera.trace", value, "0");
+    if (!atoi(value) || camera_trace_fd >= 0)
+        return;
+
+    for (unsigned i = 0; i < sizeof(kTraceMarkers) / sizeof(kTraceMarkers[0]); i++) {
+        camera_trace_fd = open(kTraceMarkers[i], O_WRONLY);
+        if (camera_trace_fd >= 0) {
+            LOGI("%s: tracing to %s", __func__, kTraceMarkers[i]);
+            return;
+        }
+    }
+    LOGW("%s: no trace_marker, is debugfs mounted?", __func__);
+}
+
+static void trace_write(const char *buf, int len)
+{
+    if (len <= 0)
+        return;
+    if (len >= TRACE_MARKER_LEN)
+        len = TRACE_MARKER_LEN - 1;
+    write(camera_trace_fd, buf, len);
+}
+
+void camera_trace_begin(const char *name)
+{
+    char buf[TRACE_MARKER_LEN];
+
+    trace_write(buf, snprintf(buf, sizeof(buf), "B|%d|%s", getpid(), name));
+}
+
+void camera_trace_end(void)
+{
+    write(camera_trace_fd, "E", 1);
+}
+
+void camera_trace_int(const char *name, int32_t value)
+{
+    char buf[TRACE_MARKER_LEN];
+
+    trace_write(buf, snprintf(buf, sizeof(buf), "C|%d|%s|%d", getpid(), name, value));
+}
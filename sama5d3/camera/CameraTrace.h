@@ -0,0 +1,65 @@
+/*
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License
+*/
+
+#ifndef ANDROID_HARDWARE_CAMERA_TRACE_H
+#define ANDROID_HARDWARE_CAMERA_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Markers in the ftrace trace_marker format systrace understands
+ * ("B|pid|name", "E", "C|pid|name|value"), so HAL work lines up with the
+ * ISI interrupts and the scheduler in one timeline. Enabled by setting
+ * camera.trace to 1 before the camera is opened. When it is off a marker
+ * is a single test of camera_trace_fd.
+ */
+
+extern int camera_trace_fd;
+
+void camera_trace_init(void);
+void camera_trace_begin(const char *name);
+void camera_trace_end(void);
+void camera_trace_int(const char *name, int32_t value);
+
+#define CAMERA_TRACE_BEGIN(name) \
+    do { if (camera_trace_fd >= 0) camera_trace_begin(name); } while (0)
+
+#define CAMERA_TRACE_END() \
+    do { if (camera_trace_fd >= 0) camera_trace_end(); } while (0)
+
+#define CAMERA_TRACE_INT(name, value) \
+    do { if (camera_trace_fd >= 0) camera_trace_int(name, value); } while (0)
+
+/* begin here, end when the enclosing block is left */
+class CameraTraceScope {
+public:
+    CameraTraceScope(const char *name) : mActive(camera_trace_fd >= 0)
+    {
+        if (mActive)
+            camera_trace_begin(name);
+    }
+    ~CameraTraceScope()
+    {
+        if (mActive)
+            camera_trace_end();
+    }
+
+private:
+    bool mActive;
+};
+
+#define CAMERA_TRACE_SCOPE(name)    CameraTraceScope __camera_trace_scope(name)
+
+#endif
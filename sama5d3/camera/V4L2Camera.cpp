@@ -20,6 +20,10 @@
 #include <utils/Log.h>
 
 #include "V4L2Camera.h"
+#include "CameraConvert.h"
+#include "CameraTrace.h"
+#include <cutils/properties.h>
+#include <utils/threads.h>
 
 extern "C" {
 #include "jpeglib.h"
@@ -139,19 +143,18 @@ static int isi_v4l2_querycap(int fp)
     return ret;
 }
 
-static const __u8* isi_v4l2_enuminput(int fp, int index)
+static int isi_v4l2_enuminput(int fp, int index, struct v4l2_input *input)
 {
-    static struct v4l2_input input;
-
 //FIXME: Under linux driver, soc_camera.c, it only support input "0"
-    input.index = 0;
-    if (ioctl(fp, VIDIOC_ENUMINPUT, &input) != 0) {
+    memset(input, 0, sizeof(*input));
+    input->index = 0;
+    if (ioctl(fp, VIDIOC_ENUMINPUT, input) != 0) {
         LOGE("ERR(%s):No matching index found\n", __func__);
-        return NULL;
+        return -1;
     }
-    LOGI("Name of input channel[%d] is %s\n", input.index, input.name);
+    LOGI("Name of input channel[%d] is %s\n", input->index, input->name);
 
-    return input.name;
+    return 0;
 }
 
 static int isi_v4l2_s_input(int fp, int index)
@@ -201,6 +204,38 @@ static int isi_v4l2_s_fmt(int fp, int width, int height, unsigned int fmt, int f
     return 0;
 }
 
+static int isi_v4l2_try_fmt(int fp, int width, int height, unsigned int fmt)
+{
+    struct v4l2_format v4l2_fmt;
+    int ret;
+
+    memset(&v4l2_fmt, 0, sizeof(v4l2_fmt));
+    v4l2_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    v4l2_fmt.fmt.pix.width = width;
+    v4l2_fmt.fmt.pix.height = height;
+    v4l2_fmt.fmt.pix.pixelformat = fmt;
+    v4l2_fmt.fmt.pix.field = V4L2_FIELD_NONE;
+
+    ret = ioctl(fp, VIDIOC_TRY_FMT, &v4l2_fmt);
+    if (ret < 0) {
+        /* not every driver implements TRY_FMT, let S_FMT decide */
+        if (errno == ENOTTY)
+            return 0;
+        LOGE("ERR(%s):VIDIOC_TRY_FMT failed\n", __func__);
+        return ret;
+    }
+
+    if ((int)v4l2_fmt.fmt.pix.width != width ||
+        (int)v4l2_fmt.fmt.pix.height != height ||
+        v4l2_fmt.fmt.pix.pixelformat != fmt) {
+        LOGE("ERR(%s):%dx%d not supported, driver offers %dx%d\n", __func__,
+             width, height, v4l2_fmt.fmt.pix.width, v4l2_fmt.fmt.pix.height);
+        return -1;
+    }
+
+    return 0;
+}
+
 static int isi_v4l2_s_fmt_cap(int fp, int width, int height, unsigned int fmt)
 {
     struct v4l2_format v4l2_fmt;
@@ -258,14 +293,15 @@ static int isi_v4l2_enum_fmt(int fp, unsigned int fmt)
     return 0;
 }
 
-static int isi_v4l2_reqbufs(int fp, enum v4l2_buf_type type, int nr_bufs)
+static int isi_v4l2_reqbufs(int fp, enum v4l2_buf_type type, int nr_bufs,
+                            enum v4l2_memory memory)
 {
     struct v4l2_requestbuffers req;
     int ret;
 
     req.count = nr_bufs;
     req.type = type;
-    req.memory = V4L2_MEMORY_MMAP;
+    req.memory = memory;
 
     ret = ioctl(fp, VIDIOC_REQBUFS, &req);
     if (ret < 0) {
@@ -294,10 +330,11 @@ static int isi_v4l2_querybuf(int fp, struct ISI_buffer *buffer, enum v4l2_buf_ty
     }
 
     buffer->length = v4l2_buf.length;
-    if ((buffer->start = (char *)mmap(0, v4l2_buf.length,
-                                      PROT_READ | PROT_WRITE, MAP_SHARED,
-                                      fp, v4l2_buf.m.offset)) < 0) {
+    buffer->start = mmap(0, v4l2_buf.length, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fp, v4l2_buf.m.offset);
+    if (buffer->start == MAP_FAILED) {
         LOGE("%s %d] mmap() failed\n",__func__, __LINE__);
+        buffer->start = NULL;
         return -1;
     }
 
@@ -354,14 +391,15 @@ static int isi_v4l2_qbuf(int fp, int index)
     return 0;
 }
 
-static int isi_v4l2_dqbuf(int fp)
+/* info, if given, gets the dequeued buffer: sequence, timestamp, flags */
+static int isi_v4l2_dqbuf(int fp, enum v4l2_memory memory, struct v4l2_buffer *info)
 {
     struct v4l2_buffer v4l2_buf;
     int ret;
     memset(&v4l2_buf,0,sizeof(v4l2_buf));
 
     v4l2_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    v4l2_buf.memory = V4L2_MEMORY_MMAP;
+    v4l2_buf.memory = memory;
     ret = ioctl(fp, VIDIOC_DQBUF, &v4l2_buf);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_DQBUF failed, dropped frame\n", __func__);
@@ -370,9 +408,37 @@ static int isi_v4l2_dqbuf(int fp)
 
     LOGV("%s: VIDIOC_DQBUF num is %d",__func__,v4l2_buf.index);
 
+    if (info)
+        *info = v4l2_buf;
+
     return v4l2_buf.index;
 }
 
+#ifndef V4L2_BUF_FLAG_TIMESTAMP_MASK
+#define V4L2_BUF_FLAG_TIMESTAMP_MASK        0xe000
+#define V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC   0x2000
+#endif
+
+/* Capture time of a dequeued buffer on the monotonic clock. Drivers that
+ * don't say which clock they used may have stamped with gettimeofday(),
+ * so go with whichever clock the stamp is closest to.
+ */
+static nsecs_t isi_v4l2_timestamp(const struct v4l2_buffer *buf)
+{
+    nsecs_t ts = s2ns(buf->timestamp.tv_sec) + us2ns(buf->timestamp.tv_usec);
+    nsecs_t mono, real;
+
+    if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+        return ts;
+
+    mono = systemTime(SYSTEM_TIME_MONOTONIC);
+    real = systemTime(SYSTEM_TIME_REALTIME);
+    if (ts > real - (real - mono) / 2)
+        ts += mono - real;
+
+    return ts;
+}
+
 static int isi_v4l2_g_ctrl(int fp, unsigned int id)
 {
     struct v4l2_control ctrl;
@@ -409,6 +475,23 @@ static int isi_v4l2_s_ctrl(int fp, unsigned int id, unsigned int value)
     return ctrl.value;
 }
 
+static int isi_v4l2_queryctrl(int fp, unsigned int id, struct v4l2_queryctrl *qctrl)
+{
+    int ret;
+
+    memset(qctrl, 0, sizeof(*qctrl));
+    qctrl->id = id;
+
+    ret = ioctl(fp, VIDIOC_QUERYCTRL, qctrl);
+    if (ret < 0)
+        return ret;
+
+    if (qctrl->flags & V4L2_CTRL_FLAG_DISABLED)
+        return -1;
+
+    return 0;
+}
+
 static int isi_v4l2_g_parm(int fp, struct v4l2_streamparm *streamparm)
 {
     int ret;
@@ -479,7 +562,19 @@ V4L2Camera::V4L2Camera ():
     m_snapshot_max_height (MAX_BACK_CAMERA_SNAPSHOT_HEIGHT),
     m_angle(-1),
     m_flag_camera_start(0),
-    m_zoom_level(-1)
+    m_zoom_level(-1),
+    m_white_balance(-1),
+    m_focus_mode(-1),
+    m_ae_enabled(0),
+    m_awb_enabled(0),
+    m_ae_wait(0),
+    m_ae_converged(false),
+    m_buffer_count(DEFAULT_BUFFERS),
+    m_requested_buffers(DEFAULT_BUFFERS),
+    m_sequence(0),
+    m_sequence_valid(false),
+    m_dropped_frames(0),
+    m_snapshot_timestamp(0)
 {
     m_params = (struct sam_cam_parm*)&m_streamparm.parm.raw_data;
     memset(&m_capture_buf, 0, sizeof(m_capture_buf));
@@ -490,6 +585,88 @@ V4L2Camera::V4L2Camera ():
 V4L2Camera::~V4L2Camera()
 {
     LOGV("%s :", __func__);
+    DeinitCamera();
+    delete ccRGBtoYUV;
+}
+
+static Mutex sNodesLock;
+static bool sNodesProbed;
+static int sNodeCount;
+static struct ISI_node sNodes[MAX_CAMERAS];
+
+static void add_camera_node(const char *path, int input, const char *name)
+{
+    struct ISI_node *node = &sNodes[sNodeCount];
+    char key[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+
+    strncpy(node->path, path, sizeof(node->path) - 1);
+    strncpy(node->name, name, sizeof(node->name) - 1);
+    node->input = input;
+
+    snprintf(key, sizeof(key), "camera.%d.facing", sNodeCount);
+    property_get(key, value, sNodeCount ? "front" : "back");
+    node->front = !strcmp(value, "front");
+
+    snprintf(key, sizeof(key), "camera.%d.orientation", sNodeCount);
+    property_get(key, value, "0");
+    node->orientation = atoi(value);
+
+    LOGI("camera %d: %s input %d (%s), %s facing, orientation %d", sNodeCount,
+         node->path, node->input, node->name, node->front ? "front" : "back",
+         node->orientation);
+    sNodeCount++;
+}
+
+/* Every node that can stream captures, input 0 of each. Done once, the
+ * sensors don't come and go.
+ */
+static void probe_camera_nodes(void)
+{
+    Mutex::Autolock lock(sNodesLock);
+
+    if (sNodesProbed)
+        return;
+    sNodesProbed = true;
+
+    for (int i = 0; i < CAMERA_DEV_MAX && sNodeCount < MAX_CAMERAS; i++) {
+        struct v4l2_capability cap;
+        struct v4l2_input input;
+        char path[32];
+        int fd;
+
+        snprintf(path, sizeof(path), "/dev/video%d", i);
+        fd = open(path, O_RDWR);
+        if (fd < 0)
+            continue;
+
+        if (ioctl(fd, VIDIOC_QUERYCAP, &cap) == 0 &&
+                (cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) &&
+                (cap.capabilities & V4L2_CAP_STREAMING) &&
+                isi_v4l2_enuminput(fd, 0, &input) == 0)
+            add_camera_node(path, 0, (const char *)input.name);
+
+        close(fd);
+    }
+
+    if (!sNodeCount) {
+        LOGW("%s: no capture node found, trying %s", __func__, CAMERA_DEV_NAME);
+        add_camera_node(CAMERA_DEV_NAME, 0, "default");
+    }
+}
+
+int V4L2Camera::getNumberOfCameras(void)
+{
+    probe_camera_nodes();
+    return sNodeCount;
+}
+
+const struct ISI_node *V4L2Camera::getCameraNode(int camera_id)
+{
+    probe_camera_nodes();
+    if (camera_id < 0 || camera_id >= sNodeCount)
+        return NULL;
+    return &sNodes[camera_id];
 }
 
 int V4L2Camera::initCamera(int index)
@@ -498,31 +675,37 @@ int V4L2Camera::initCamera(int index)
     int ret = 0;
 
     if (!m_flag_init) {
-        m_cam_fd = open(CAMERA_DEV_NAME, O_RDWR);
+        const struct ISI_node *node = getCameraNode(index);
+        struct v4l2_input input;
+
+        if (!node) {
+            LOGE("ERR(%s):No camera %d\n", __func__, index);
+            return -1;
+        }
+
+        m_camera_id = index;
+        m_cam_fd = open(node->path, O_RDWR);
         if (m_cam_fd < 0) {
-            LOGE("ERR(%s):Cannot open %s (error : %s)\n", __func__, CAMERA_DEV_NAME, strerror(errno));
+            LOGE("ERR(%s):Cannot open %s (error : %s)\n", __func__, node->path, strerror(errno));
             return -1;
         }
-        LOGE("initCamera: m_cam_fd(%d)", m_cam_fd);
+        LOGI("initCamera: camera %d on %s, m_cam_fd(%d)", index, node->path, m_cam_fd);
         ret = isi_v4l2_querycap(m_cam_fd);
         CHECK(ret);
-        if (!isi_v4l2_enuminput(m_cam_fd, index))
+        if (isi_v4l2_enuminput(m_cam_fd, node->input, &input) < 0)
             return -1;
-        ret = isi_v4l2_s_input(m_cam_fd, index);
+        ret = isi_v4l2_s_input(m_cam_fd, node->input);
         CHECK(ret);
 
-        m_camera_id = index;
-        switch (m_camera_id) {
-        case CAMERA_ID_FRONT:
-            LOGE("We don't support a front camera");
-            return -1;
-            break;
+        /* both ISIs carry the same sensor family, see ov2640.c */
+        m_preview_max_width   = MAX_BACK_CAMERA_PREVIEW_WIDTH;
+        m_preview_max_height  = MAX_BACK_CAMERA_PREVIEW_HEIGHT;
 
-        case CAMERA_ID_BACK:
-            m_preview_max_width   = MAX_BACK_CAMERA_PREVIEW_WIDTH;
-            m_preview_max_height  = MAX_BACK_CAMERA_PREVIEW_HEIGHT;
-            break;
-        }
+        initAutoExposure();
+
+        char value[PROPERTY_VALUE_MAX];
+        property_get("camera.buffers", value, "0");
+        setBufferCount(atoi(value) > 0 ? atoi(value) : DEFAULT_BUFFERS);
 
         m_flag_init = 1;
     }
@@ -593,17 +776,17 @@ int V4L2Camera::startPreview(void)
     ret = isi_v4l2_s_fmt(m_cam_fd, m_preview_width,m_preview_height,m_preview_v4lformat, 0);
     CHECK(ret);
 
-    ret = isi_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, MAX_BUFFERS);
+    ret = requestPreviewBuffers();
     CHECK(ret);
 
     if(ccRGBtoYUV != NULL)
         ccRGBtoYUV->Init(m_preview_width, m_preview_height, m_preview_width, m_preview_width, m_preview_height, ((m_preview_width + 15) >> 4) << 4, 0);
 
-    LOGD("%s : m_preview_width: %d m_preview_height: %d m_angle: %d\n",
-         __func__, m_preview_width, m_preview_height, m_angle);
+    LOGD("%s : m_preview_width: %d m_preview_height: %d m_angle: %d buffers: %d\n",
+         __func__, m_preview_width, m_preview_height, m_angle, m_buffer_count);
 
     /* start with all buffers in queue */
-    for (int i = 0; i < MAX_BUFFERS; i++) {
+    for (int i = 0; i < m_buffer_count; i++) {
         ret = isi_v4l2_qbuf(m_cam_fd, i);
         CHECK(ret);
     }
@@ -612,6 +795,8 @@ int V4L2Camera::startPreview(void)
     CHECK(ret);
 
     m_flag_camera_start = 1;
+    m_ae_converged = false;
+    m_ae_wait = 0;
 
     ret = isi_poll(&m_events_c);
     CHECK(ret);
@@ -645,7 +830,7 @@ int V4L2Camera::stopPreview(void)
     return ret;
 }
 
-int V4L2Camera::getPreviewframe()
+int V4L2Camera::getPreviewframe(nsecs_t *timestamp)
 {
     int index;
     int ret;
@@ -664,14 +849,28 @@ int V4L2Camera::getPreviewframe()
             return 0;
         }
     }
-    previewPoll(true);
+    struct v4l2_buffer info;
 
-    index = isi_v4l2_dqbuf(m_cam_fd);
-    if (!(0 <= index && index < MAX_BUFFERS)) {
+    CAMERA_TRACE_BEGIN("getPreviewframe");
+    previewPoll(true);
+    index = isi_v4l2_dqbuf(m_cam_fd, V4L2_MEMORY_MMAP, &info);
+    CAMERA_TRACE_END();
+    if (!(0 <= index && index < m_buffer_count)) {
         LOGE("ERR(%s):wrong index = %d\n", __func__, index);
         return -1;
     }
 
+    /* the ISI counts every frame, including the ones it had no buffer for */
+    if (m_sequence_valid && info.sequence - m_sequence > 1)
+        m_dropped_frames += info.sequence - m_sequence - 1;
+    m_sequence = info.sequence;
+    m_sequence_valid = true;
+    CAMERA_TRACE_INT("isi.sequence", info.sequence);
+    CAMERA_TRACE_INT("isi.dropped", m_dropped_frames);
+
+    if (timestamp)
+        *timestamp = isi_v4l2_timestamp(&info);
+
     return index;
 }
 
@@ -708,6 +907,62 @@ int V4L2Camera::setPreviewSize(int width, int height, int pixel_format)
     return 0;
 }
 
+/* Check a preview size against the driver without touching the running
+ * stream, so a resolution switch can be validated ahead of time.
+ */
+int V4L2Camera::tryPreviewSize(int width, int height, int pixel_format)
+{
+    if (m_cam_fd <= 0) {
+        LOGE("ERR(%s):Camera was closed\n", __func__);
+        return -1;
+    }
+
+    return isi_v4l2_try_fmt(m_cam_fd, width, height, pixel_format);
+}
+
+/* Move a running preview to a new size between two frames. Unlike
+ * stopPreview()/startPreview() this skips format enumeration, the
+ * stream parameters and the wait for the first frame, so the display
+ * only misses the frames in flight. The caller must have dropped its
+ * mappings of the old buffers.
+ */
+int V4L2Camera::switchPreview(int width, int height, int pixel_format)
+{
+    int ret;
+
+    LOGV("%s(width(%d), height(%d), format(%d))", __func__, width, height, pixel_format);
+
+    if (m_flag_camera_start == 0)
+        return setPreviewSize(width, height, pixel_format);
+
+    ret = isi_v4l2_streamoff(m_cam_fd);
+    CHECK(ret);
+    m_flag_camera_start = 0;
+
+    setPreviewSize(width, height, pixel_format);
+
+    ret = isi_v4l2_s_fmt(m_cam_fd, m_preview_width, m_preview_height, m_preview_v4lformat, 0);
+    CHECK(ret);
+
+    ret = requestPreviewBuffers();
+    CHECK(ret);
+
+    if(ccRGBtoYUV != NULL)
+        ccRGBtoYUV->Init(m_preview_width, m_preview_height, m_preview_width, m_preview_width, m_preview_height, ((m_preview_width + 15) >> 4) << 4, 0);
+
+    for (int i = 0; i < m_buffer_count; i++) {
+        ret = isi_v4l2_qbuf(m_cam_fd, i);
+        CHECK(ret);
+    }
+
+    ret = isi_v4l2_streamon(m_cam_fd);
+    CHECK(ret);
+
+    m_flag_camera_start = 1;
+
+    return 0;
+}
+
 int V4L2Camera::getPreviewSize(int *width, int *height, int *frame_size)
 {
     *width  = m_preview_width;
@@ -730,6 +985,46 @@ int V4L2Camera::getPreviewPixelFormat(void)
     return m_preview_v4lformat;
 }
 
+/* Depth of the capture queue, used from the next startPreview() or
+ * switchPreview(). Returns the clamped count.
+ */
+int V4L2Camera::setBufferCount(int count)
+{
+    if (count < MIN_BUFFERS)
+        count = MIN_BUFFERS;
+    if (count > MAX_BUFFERS)
+        count = MAX_BUFFERS;
+
+    m_requested_buffers = count;
+    return count;
+}
+
+/* buffers of the current stream, may be less than requested */
+int V4L2Camera::getBufferCount(void)
+{
+    return m_buffer_count;
+}
+
+/* frames the ISI dropped for lack of a queued buffer, since open */
+int V4L2Camera::getDroppedFrames(void)
+{
+    return m_dropped_frames;
+}
+
+int V4L2Camera::requestPreviewBuffers(void)
+{
+    int ret = isi_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                               m_requested_buffers, V4L2_MEMORY_MMAP);
+    if (ret < MIN_BUFFERS) {
+        LOGE("ERR(%s):driver gave %d buffers, need %d\n", __func__, ret, MIN_BUFFERS);
+        return -1;
+    }
+
+    m_buffer_count = MIN(ret, MAX_BUFFERS);
+    m_sequence_valid = false;
+    return 0;
+}
+
 //Recording
 int V4L2Camera::startRecord(void)
 {
@@ -815,17 +1110,8 @@ int V4L2Camera::getSnapshotSize(int *width, int *height, int *frame_size)
 
 int V4L2Camera::getSnapshotMaxSize(int *width, int *height)
 {
-    switch (m_camera_id) {
-    case CAMERA_ID_FRONT:
-        LOGE("We don't support a front camera");
-        break;
-
-    default:
-    case CAMERA_ID_BACK:
-        m_snapshot_max_width  = MAX_BACK_CAMERA_SNAPSHOT_WIDTH;
-        m_snapshot_max_height = MAX_BACK_CAMERA_SNAPSHOT_HEIGHT;
-        break;
-    }
+    m_snapshot_max_width  = MAX_BACK_CAMERA_SNAPSHOT_WIDTH;
+    m_snapshot_max_height = MAX_BACK_CAMERA_SNAPSHOT_HEIGHT;
 
     *width  = m_snapshot_max_width;
     *height = m_snapshot_max_height;
@@ -865,6 +1151,7 @@ int V4L2Camera::getSnapshotPixelFormat(void)
 
 int V4L2Camera::startSnapshot(void *rawbuf)
 {
+    CAMERA_TRACE_SCOPE("startSnapshot");
     v4l2_streamparm streamparm;
     LOGV("%s : enter", __func__);
 
@@ -893,16 +1180,10 @@ int V4L2Camera::startSnapshot(void *rawbuf)
     ret = isi_v4l2_s_fmt(m_cam_fd, m_snapshot_width,m_snapshot_height,m_snapshot_v4lformat, 0);
     CHECK(ret);
 
-    ret = isi_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, 1);
-    CHECK(ret);
-
     LOGV("%s : m_snapshot_width: %d m_snapshot_height: %d m_angle: %d\n",
          __func__, m_snapshot_width, m_snapshot_height, m_angle);
 
-    ret = isi_v4l2_querybuf(m_cam_fd, &m_capture_buf, V4L2_BUF_TYPE_VIDEO_CAPTURE, 0);
-    CHECK(ret);
-
-    ret = isi_v4l2_qbuf(m_cam_fd, 0);
+    ret = setupSnapshotBuffer();
     CHECK(ret);
 
     ret = isi_v4l2_streamon(m_cam_fd);
@@ -911,16 +1192,24 @@ int V4L2Camera::startSnapshot(void *rawbuf)
     ret = isi_poll(&m_events_c);
     CHECK(ret);
 
-    isi_v4l2_dqbuf(m_cam_fd);
+    struct v4l2_buffer info;
+
+    memset(&info, 0, sizeof(info));
+    ret = isi_v4l2_dqbuf(m_cam_fd, V4L2_MEMORY_MMAP, &info);
+    CHECK(ret);
 
     for(int i=0; i < SKIP_PICTURE_FRAMES; i++) {
         ret = isi_v4l2_qbuf(m_cam_fd, 0);
         CHECK(ret);
         ret = isi_poll(&m_events_c);
         CHECK(ret);
-        isi_v4l2_dqbuf(m_cam_fd);
+        ret = isi_v4l2_dqbuf(m_cam_fd, V4L2_MEMORY_MMAP, &info);
+        CHECK(ret);
     }
 
+    /* the frame we keep is the last one */
+    m_snapshot_timestamp = isi_v4l2_timestamp(&info);
+
     memcpy(rawbuf, m_capture_buf.start, m_frameSize(m_snapshot_v4lformat, m_snapshot_width, m_snapshot_height));
 
     LOGV("%s : exit", __func__);
@@ -928,22 +1217,44 @@ int V4L2Camera::startSnapshot(void *rawbuf)
     return 0;
 }
 
+/* One mapped driver buffer, queued. The ISI writes only contiguous
+ * memory, so the frame is copied out to the caller after the shot.
+ */
+int V4L2Camera::setupSnapshotBuffer(void)
+{
+    int ret;
+
+    m_capture_buf.start = NULL;
+    m_capture_buf.length = 0;
+
+    ret = isi_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, 1,
+                           V4L2_MEMORY_MMAP);
+    CHECK(ret);
+
+    ret = isi_v4l2_querybuf(m_cam_fd, &m_capture_buf, V4L2_BUF_TYPE_VIDEO_CAPTURE, 0);
+    CHECK(ret);
+
+    return isi_v4l2_qbuf(m_cam_fd, 0);
+}
+
 int V4L2Camera::stopSnapshot(void)
 {
     int ret;
 
     LOGV("%s :", __func__);
+
+    ret = isi_v4l2_streamoff(m_cam_fd);
+
     if (m_capture_buf.start) {
+        /* must go before preview can reallocate the driver buffers */
         munmap(m_capture_buf.start, m_capture_buf.length);
         LOGI("munmap():virt. addr %p size = %d\n",
              m_capture_buf.start, m_capture_buf.length);
-        m_capture_buf.start = NULL;
-        m_capture_buf.length = 0;
     }
+    m_capture_buf.start = NULL;
+    m_capture_buf.length = 0;
 
-    ret = isi_v4l2_streamoff(m_cam_fd);
     CHECK(ret);
-
     return 0;
 }
 
@@ -956,9 +1267,18 @@ void V4L2Camera::getPostViewConfig(int *width, int *height, int *size)
          m_preview_width, *width, *height, *size);
 }
 
+/* the JPEG goes through a file, one per camera so two can shoot at once */
+static void jpeg_path(char *path, size_t len, int camera_id)
+{
+    snprintf(path, len, "/tmp/tmp%d.jpeg", camera_id);
+}
+
 int V4L2Camera::SavePicture(void)
 {
-    return savePicture((unsigned char *)m_capture_buf.start, "/tmp/tmp.jpeg");
+    char path[32];
+
+    jpeg_path(path, sizeof(path), m_camera_id);
+    return savePicture((unsigned char *)m_capture_buf.start, path);
 }
 
 int V4L2Camera::savePicture(unsigned char *inputBuffer, const char * filename)
@@ -984,8 +1304,12 @@ int V4L2Camera::savePicture(unsigned char *inputBuffer, const char * filename)
 
 int V4L2Camera::readjpeg(void *previewBuffer,int fileSize)
 {
+    CAMERA_TRACE_SCOPE("readjpeg");
     FILE *input;
-    input = fopen("/tmp/tmp.jpeg", "rb");
+    char path[32];
+
+    jpeg_path(path, sizeof(path), m_camera_id);
+    input = fopen(path, "rb");
     if (input == NULL)
         LOGE("readjpeg: Input file == NULL");
     else if(previewBuffer == NULL)
@@ -999,16 +1323,94 @@ int V4L2Camera::readjpeg(void *previewBuffer,int fileSize)
     return fileSize;
 }
 
+/* Little endian TIFF helpers for the EXIF block */
+static uint8_t *exif_put16(uint8_t *p, unsigned int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    return p + 2;
+}
+
+static uint8_t *exif_put32(uint8_t *p, unsigned int v)
+{
+    p = exif_put16(p, v & 0xffff);
+    return exif_put16(p, v >> 16);
+}
+
+static uint8_t *exif_entry(uint8_t *p, unsigned int tag, unsigned int type,
+                           unsigned int count, unsigned int value)
+{
+    p = exif_put16(p, tag);
+    p = exif_put16(p, type);
+    p = exif_put32(p, count);
+    return exif_put32(p, value);
+}
+
+#define EXIF_TYPE_ASCII         2
+#define EXIF_TYPE_LONG          4
+#define EXIF_DATETIME_LEN       20      /* "YYYY:MM:DD HH:MM:SS" */
+#define EXIF_HEADER_LEN         6       /* "Exif\0\0" */
+#define EXIF_IFD0_OFFSET        8
+#define EXIF_IFD0_DATA          (EXIF_IFD0_OFFSET + 2 + 2 * 12 + 4)
+#define EXIF_SUBIFD_OFFSET      (EXIF_IFD0_DATA + EXIF_DATETIME_LEN)
+#define EXIF_SUBIFD_DATA        (EXIF_SUBIFD_OFFSET + 2 + 2 * 12 + 4)
+#define EXIF_TIFF_LEN           (EXIF_SUBIFD_DATA + EXIF_DATETIME_LEN)
+#define EXIF_LEN                (EXIF_HEADER_LEN + EXIF_TIFF_LEN)
+
+/*
+ * APP1 payload with DateTime, DateTimeOriginal and SubSecTimeOriginal for a
+ * capture at the given monotonic time, in local time like other cameras.
+ */
+static int build_exif(uint8_t *buf, nsecs_t capture_time)
+{
+    nsecs_t wall = capture_time + systemTime(SYSTEM_TIME_REALTIME) -
+                   systemTime(SYSTEM_TIME_MONOTONIC);
+    time_t sec = (time_t)(wall / 1000000000LL);
+    int msec = (int)((wall / 1000000LL) % 1000);
+    char datetime[EXIF_DATETIME_LEN];
+    struct tm tm;
+    uint8_t *tiff = buf + EXIF_HEADER_LEN;
+    uint8_t *p;
+
+    localtime_r(&sec, &tm);
+    strftime(datetime, sizeof(datetime), "%Y:%m:%d %H:%M:%S", &tm);
+
+    memcpy(buf, "Exif\0\0", EXIF_HEADER_LEN);
+    p = exif_put16(tiff, 0x4949);           /* "II" */
+    p = exif_put16(p, 42);
+    p = exif_put32(p, EXIF_IFD0_OFFSET);
+
+    /* IFD0: DateTime, pointer to the Exif IFD */
+    p = exif_put16(p, 2);
+    p = exif_entry(p, 0x0132, EXIF_TYPE_ASCII, EXIF_DATETIME_LEN, EXIF_IFD0_DATA);
+    p = exif_entry(p, 0x8769, EXIF_TYPE_LONG, 1, EXIF_SUBIFD_OFFSET);
+    p = exif_put32(p, 0);
+    memcpy(p, datetime, EXIF_DATETIME_LEN);
+    p += EXIF_DATETIME_LEN;
+
+    /* Exif IFD: DateTimeOriginal, SubSecTimeOriginal (fits in the entry) */
+    p = exif_put16(p, 2);
+    p = exif_entry(p, 0x9003, EXIF_TYPE_ASCII, EXIF_DATETIME_LEN, EXIF_SUBIFD_DATA);
+    p = exif_put16(p, 0x9291);
+    p = exif_put16(p, EXIF_TYPE_ASCII);
+    p = exif_put32(p, 4);
+    snprintf((char *)p, 4, "%03d", msec);
+    p += 4;
+    p = exif_put32(p, 0);
+    memcpy(p, datetime, EXIF_DATETIME_LEN);
+    p += EXIF_DATETIME_LEN;
+
+    return p - buf;
+}
+
 int V4L2Camera::saveYUYVtoJPEG (unsigned char *inputBuffer, int width, int height, FILE *file, int quality)
 {
+    CAMERA_TRACE_SCOPE("jpegEncode");
     struct jpeg_compress_struct cinfo;
     struct jpeg_error_mgr jerr;
     JSAMPROW row_pointer[1];
     unsigned char *line_buffer;
-    unsigned char Y1, Y2, U, V;
-    register int r,g,b;
-    unsigned int y=0;
-    int line,col;
+    int line;
 
     int fileSize;
 
@@ -1026,34 +1428,21 @@ int V4L2Camera::saveYUYVtoJPEG (unsigned char *inputBuffer, int width, int heigh
     jpeg_set_defaults (&cinfo);
     jpeg_set_quality (&cinfo, quality, TRUE);
 
-    jpeg_start_compress (&cinfo, TRUE);
-
-    for (line = 0; line < height; line++) {
-        unsigned char *ptr = line_buffer;
-        for (col = 0; col < width; col+=2) {
-            Y1 = inputBuffer[y + 0];
-            V = inputBuffer[y + 1];
-            Y2 = inputBuffer[y + 2];
-            U = inputBuffer[y + 3];
-
-            r = (1192 * (Y1 - 16) + 1634 * (V - 128) ) >> 10;
-            g = (1192 * (Y1 - 16) - 833 * (V - 128) - 400 * (U -128) ) >> 10;
-            b = (1192 * (Y1 - 16) + 2066 * (U - 128) ) >> 10;
+    /* EXIF replaces JFIF, APP1 has to follow SOI */
+    if (m_snapshot_timestamp)
+        cinfo.write_JFIF_header = FALSE;
 
-            *(ptr++) = (r > 255) ? 255 : ((r < 0) ? 0 : r);
-            *(ptr++) = (g > 255) ? 255 : ((g < 0) ? 0 : g);
-            *(ptr++) = (b > 255) ? 255 : ((b < 0) ? 0 : b);
+    jpeg_start_compress (&cinfo, TRUE);
 
-            r = (1192 * (Y2 - 16) + 1634 * (V - 128) ) >> 10;
-            g = (1192 * (Y2 - 16) - 833 * (V - 128) - 400 * (U -128) ) >> 10;
-            b = (1192 * (Y2 - 16) + 2066 * (U - 128) ) >> 10;
+    if (m_snapshot_timestamp) {
+        uint8_t exif[EXIF_LEN];
+        int len = build_exif(exif, m_snapshot_timestamp);
 
-            *(ptr++) = (r > 255) ? 255 : ((r < 0) ? 0 : r);
-            *(ptr++) = (g > 255) ? 255 : ((g < 0) ? 0 : g);
-            *(ptr++) = (b > 255) ? 255 : ((b < 0) ? 0 : b);
+        jpeg_write_marker(&cinfo, JPEG_APP0 + 1, exif, len);
+    }
 
-            y = y+4;
-        }//line end
+    for (line = 0; line < height; line++) {
+        yvyu_to_rgb888_line(inputBuffer + line * width * 2, line_buffer, width);
 
         row_pointer[0] = line_buffer;
         jpeg_write_scanlines (&cinfo, row_pointer, 1);
@@ -1069,51 +1458,9 @@ int V4L2Camera::saveYUYVtoJPEG (unsigned char *inputBuffer, int width, int heigh
 
 }
 
-static inline void yuv_to_rgb16(unsigned char y,
-                                unsigned char u,
-                                unsigned char v,
-                                unsigned char *rgb)
-{
-    register int r,g,b;
-    int rgb16;
-
-    r = (1192 * (y - 16) + 1634 * (v - 128) ) >> 10;
-    g = (1192 * (y - 16) - 833 * (v - 128) - 400 * (u -128) ) >> 10;
-    b = (1192 * (y - 16) + 2066 * (u - 128) ) >> 10;
-
-    r = r > 255 ? 255 : r < 0 ? 0 : r;
-    g = g > 255 ? 255 : g < 0 ? 0 : g;
-    b = b > 255 ? 255 : b < 0 ? 0 : b;
-
-    rgb16 = (int)(((r >> 3)<<11) | ((g >> 2) << 5)| ((b >> 3) << 0));
-
-    *rgb = (unsigned char)(rgb16 & 0xFF);
-    rgb++;
-    *rgb = (unsigned char)((rgb16 & 0xFF00) >> 8);
-
-}
-
 void V4L2Camera::convert(void *buf_in, void *rgb_in, int width, int height)
 {
-    int x,y,z=0;
-    int blocks;
-
-    unsigned char *buf = (unsigned char *) buf_in;
-    unsigned char *rgb = (unsigned char *) rgb_in;
-
-    blocks = (width * height) * 2;
-
-    for (y = 0; y < blocks; y+=4) {
-        unsigned char Y1, Y2, U, V;
-
-        U = buf[y + 0];
-        Y1 = buf[y + 1];
-        V = buf[y + 2];
-        Y2 = buf[y + 3];
-
-        yuv_to_rgb16(Y1, U, V, &rgb[y]);
-        yuv_to_rgb16(Y2, U, V, &rgb[y + 2]);
-    }
+    uyvy_to_rgb565((const uint8_t *)buf_in, (uint8_t *)rgb_in, width, height);
 }
 
 int V4L2Camera::setCameraId(int camera_id)
@@ -1188,6 +1535,348 @@ int V4L2Camera::getRotate(void)
     return m_angle;
 }
 
+/* Controls below are applied with VIDIOC_S_CTRL on the open device and
+ * take effect on the running stream; none of them need a stream restart.
+ */
+bool V4L2Camera::hasControl(unsigned int id)
+{
+    struct v4l2_queryctrl qctrl;
+
+    if (m_cam_fd <= 0)
+        return false;
+
+    return isi_v4l2_queryctrl(m_cam_fd, id, &qctrl) == 0;
+}
+
+int V4L2Camera::getControlRange(unsigned int id, int *min, int *max, int *step)
+{
+    struct v4l2_queryctrl qctrl;
+
+    if (m_cam_fd <= 0 || isi_v4l2_queryctrl(m_cam_fd, id, &qctrl) < 0)
+        return -1;
+
+    *min  = qctrl.minimum;
+    *max  = qctrl.maximum;
+    *step = qctrl.step > 0 ? qctrl.step : 1;
+
+    return 0;
+}
+
+int V4L2Camera::setControl(unsigned int id, int value)
+{
+    int ret;
+
+    if (m_cam_fd <= 0) {
+        LOGE("ERR(%s):Camera was closed\n", __func__);
+        return -1;
+    }
+
+    ret = isi_v4l2_s_ctrl(m_cam_fd, id, value);
+    CHECK(ret);
+
+    return 0;
+}
+
+int V4L2Camera::getControl(unsigned int id, int *value)
+{
+    int ret;
+
+    if (m_cam_fd <= 0) {
+        LOGE("ERR(%s):Camera was closed\n", __func__);
+        return -1;
+    }
+
+    ret = isi_v4l2_g_ctrl(m_cam_fd, id);
+    CHECK(ret);
+
+    *value = ret;
+    return 0;
+}
+
+// ======================================================================
+// Software auto exposure / white balance
+
+/* mean luma the exposure loop aims for, and how close is close enough */
+#define AE_TARGET_LUMA      118
+#define AE_TOLERANCE        10
+/* share of the samples in the top histogram bin that lowers the target */
+#define AE_CLIP_PERCENT     3
+/* grey-world: mean chroma within this of 128 counts as neutral */
+#define AWB_TOLERANCE       3
+/* frames the sensor needs before new settings show up */
+#define AE_SETTLE_FRAMES    2
+
+int V4L2Camera::initControl(struct ISI_control *ctrl, unsigned int id)
+{
+    int step;
+
+    memset(ctrl, 0, sizeof(*ctrl));
+    ctrl->id = id;
+
+    if (getControlRange(id, &ctrl->min, &ctrl->max, &step) < 0 ||
+        ctrl->max <= ctrl->min)
+        return -1;
+
+    if (getControl(id, &ctrl->value) < 0)
+        ctrl->value = ctrl->min;
+
+    ctrl->supported = 1;
+    return 0;
+}
+
+/* The loop only runs on sensors that expose manual exposure/gain or
+ * colour balance but no automatic mode of their own. camera.soft_ae
+ * set to 0 turns it off, set to 1 forces it on and puts the sensor's
+ * own automatic modes in manual.
+ */
+void V4L2Camera::initAutoExposure(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+    bool hw_ae, hw_awb;
+
+    property_get("camera.soft_ae", value, "");
+
+    initControl(&m_ae_exposure, V4L2_CID_EXPOSURE);
+    initControl(&m_ae_gain, V4L2_CID_GAIN);
+    initControl(&m_awb_red, V4L2_CID_RED_BALANCE);
+    initControl(&m_awb_blue, V4L2_CID_BLUE_BALANCE);
+
+    hw_ae = hasControl(V4L2_CID_EXPOSURE_AUTO) || hasControl(V4L2_CID_AUTOGAIN);
+    hw_awb = hasControl(V4L2_CID_AUTO_WHITE_BALANCE);
+
+    m_ae_enabled = m_ae_exposure.supported || m_ae_gain.supported;
+    m_awb_enabled = m_awb_red.supported && m_awb_blue.supported;
+
+    if (!strcmp(value, "0")) {
+        m_ae_enabled = 0;
+        m_awb_enabled = 0;
+    } else if (!strcmp(value, "1")) {
+        if (m_ae_enabled && hw_ae) {
+            if (hasControl(V4L2_CID_EXPOSURE_AUTO))
+                isi_v4l2_s_ctrl(m_cam_fd, V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_MANUAL);
+            if (hasControl(V4L2_CID_AUTOGAIN))
+                isi_v4l2_s_ctrl(m_cam_fd, V4L2_CID_AUTOGAIN, 0);
+        }
+        if (m_awb_enabled && hw_awb)
+            isi_v4l2_s_ctrl(m_cam_fd, V4L2_CID_AUTO_WHITE_BALANCE, 0);
+    } else {
+        if (hw_ae)
+            m_ae_enabled = 0;
+        if (hw_awb)
+            m_awb_enabled = 0;
+    }
+
+    LOGI("%s : software AE %s, AWB %s", __func__,
+         m_ae_enabled ? "on" : "off", m_awb_enabled ? "on" : "off");
+}
+
+bool V4L2Camera::autoExposureEnabled(void)
+{
+    return m_ae_enabled || m_awb_enabled;
+}
+
+/* Scale a control by ratio (8.8 fixed point) within its range and
+ * return the part of the ratio it could not absorb.
+ */
+int V4L2Camera::scaleControl(struct ISI_control *ctrl, int ratio)
+{
+    int cur, want;
+
+    if (!ctrl->supported || ratio == 256)
+        return ratio;
+
+    cur = ctrl->value > 0 ? ctrl->value : 1;
+    want = (int)(((long long)cur * ratio) >> 8);
+    /* always move by at least one unit */
+    if (want == cur)
+        want += ratio > 256 ? 1 : -1;
+    if (want < ctrl->min)
+        want = ctrl->min;
+    if (want > ctrl->max)
+        want = ctrl->max;
+
+    if (want == ctrl->value)
+        return ratio;
+
+    if (isi_v4l2_s_ctrl(m_cam_fd, ctrl->id, want) < 0) {
+        ctrl->supported = 0;
+        return ratio;
+    }
+    ctrl->value = want;
+
+    if (want <= 0)
+        return ratio;
+    return (int)(((long long)ratio * cur) / want);
+}
+
+int V4L2Camera::stepControl(struct ISI_control *ctrl, int delta)
+{
+    int want = ctrl->value + delta;
+
+    if (want < ctrl->min)
+        want = ctrl->min;
+    if (want > ctrl->max)
+        want = ctrl->max;
+
+    if (want == ctrl->value)
+        return 0;
+
+    if (isi_v4l2_s_ctrl(m_cam_fd, ctrl->id, want) < 0)
+        return -1;
+
+    ctrl->value = want;
+    return 0;
+}
+
+/* One damped step of the AE/AWB loop per preview frame, skipping the
+ * frames still exposed with the previous settings. Returns true once
+ * exposure and white balance are on target.
+ */
+bool V4L2Camera::updateAutoExposure(const struct yuyv_stats *stats)
+{
+    bool converged = true;
+
+    if (!autoExposureEnabled() || stats->count == 0)
+        return true;
+
+    if (m_ae_wait > 0) {
+        m_ae_wait--;
+        return m_ae_converged;
+    }
+
+    if (m_ae_enabled) {
+        int mean = stats->sum_y / stats->count;
+        int target = AE_TARGET_LUMA;
+        uint32_t clipped = stats->histogram[LUMA_HISTOGRAM_BINS - 1];
+
+        /* highlights clipping: aim lower */
+        if (clipped * 100 > stats->count * AE_CLIP_PERCENT)
+            target = target * 3 / 4;
+
+        if (mean < target - AE_TOLERANCE || target + AE_TOLERANCE < mean) {
+            int ratio;
+
+            converged = false;
+            if (mean < 1)
+                mean = 1;
+            ratio = (target << 8) / mean;
+            if (ratio > 512)
+                ratio = 512;
+            if (ratio < 128)
+                ratio = 128;
+            /* go half way there */
+            ratio = 256 + (ratio - 256) / 2;
+
+            if (ratio > 256) {
+                /* brighter: longer exposure first, gain adds noise */
+                ratio = scaleControl(&m_ae_exposure, ratio);
+                scaleControl(&m_ae_gain, ratio);
+            } else {
+                ratio = scaleControl(&m_ae_gain, ratio);
+                scaleControl(&m_ae_exposure, ratio);
+            }
+        }
+    }
+
+    if (m_awb_enabled && m_white_balance <= WHITE_BALANCE_AUTO) {
+        int u = (int)(stats->sum_u / stats->count) - 128;
+        int v = (int)(stats->sum_v / stats->count) - 128;
+
+        /* grey world: Cr above neutral means too much red, Cb too
+         * much blue. Steps are a quarter of the error over the range.
+         */
+        if (v < -AWB_TOLERANCE || AWB_TOLERANCE < v) {
+            int delta = -v * (m_awb_red.max - m_awb_red.min) / 512;
+
+            converged = false;
+            if (delta == 0)
+                delta = v > 0 ? -1 : 1;
+            stepControl(&m_awb_red, delta);
+        }
+        if (u < -AWB_TOLERANCE || AWB_TOLERANCE < u) {
+            int delta = -u * (m_awb_blue.max - m_awb_blue.min) / 512;
+
+            converged = false;
+            if (delta == 0)
+                delta = u > 0 ? -1 : 1;
+            stepControl(&m_awb_blue, delta);
+        }
+    }
+
+    if (!converged)
+        m_ae_wait = AE_SETTLE_FRAMES;
+    m_ae_converged = converged;
+
+    return converged;
+}
+
+int V4L2Camera::setWhiteBalance(int white_balance)
+{
+    /* colour temperature in Kelvin used for the manual presets */
+    static const int wb_temperature[WHITE_BALANCE_MAX] = {
+        0,      /* WHITE_BALANCE_AUTO */
+        2800,   /* WHITE_BALANCE_INCANDESCENT */
+        4000,   /* WHITE_BALANCE_FLUORESCENT */
+        5500,   /* WHITE_BALANCE_DAYLIGHT */
+        6500,   /* WHITE_BALANCE_CLOUDY_DAYLIGHT */
+    };
+    int ret;
+
+    LOGV("%s(white_balance(%d))", __func__, white_balance);
+
+    if (white_balance < WHITE_BALANCE_AUTO || WHITE_BALANCE_MAX <= white_balance) {
+        LOGE("ERR(%s):Invalid white_balance(%d)", __func__, white_balance);
+        return -1;
+    }
+
+    if (m_white_balance == white_balance)
+        return 0;
+
+    /* sensors without white balance controls only do auto */
+    if (!hasControl(V4L2_CID_AUTO_WHITE_BALANCE)) {
+        if (white_balance != WHITE_BALANCE_AUTO)
+            return -1;
+        m_white_balance = white_balance;
+        return 0;
+    }
+
+    ret = isi_v4l2_s_ctrl(m_cam_fd, V4L2_CID_AUTO_WHITE_BALANCE,
+                          white_balance == WHITE_BALANCE_AUTO);
+    CHECK(ret);
+
+    if (white_balance != WHITE_BALANCE_AUTO) {
+        ret = isi_v4l2_s_ctrl(m_cam_fd, V4L2_CID_WHITE_BALANCE_TEMPERATURE,
+                              wb_temperature[white_balance]);
+        CHECK(ret);
+    }
+
+    m_white_balance = white_balance;
+    return 0;
+}
+
+int V4L2Camera::getWhiteBalance(void)
+{
+    return m_white_balance;
+}
+
+int V4L2Camera::setFocusMode(int focus_mode)
+{
+    LOGV("%s(focus_mode(%d))", __func__, focus_mode);
+
+    if (focus_mode < FOCUS_MODE_AUTO || FOCUS_MODE_MAX <= focus_mode) {
+        LOGE("ERR(%s):Invalid focus_mode(%d)", __func__, focus_mode);
+        return -1;
+    }
+
+    m_focus_mode = focus_mode;
+    return 0;
+}
+
+int V4L2Camera::getFocusMode(void)
+{
+    return m_focus_mode;
+}
+
 void V4L2Camera::rgb16TOyuv420(void *rgb16, void *yuv420)
 {
     if(ccRGBtoYUV != NULL)
@@ -36,8 +36,10 @@
 #include <sys/stat.h>
 
 #include <linux/videodev2.h>
+#include <utils/Timers.h>
 
 #include "ccrgb16toyuv420.h"
+#include "CameraStats.h"
 
 namespace android {
 
@@ -66,11 +68,19 @@ namespace android {
 #define LOG_TIME(n)
 #endif
 
+/* capture nodes are found by probing /dev/video0..CAMERA_DEV_MAX-1, with
+ * CAMERA_DEV_NAME as the only camera if none answers
+ */
 #define CAMERA_DEV_NAME   "/dev/video1"
+#define CAMERA_DEV_MAX    8
+#define MAX_CAMERAS       2     /* as many as CameraService handles */
 
 #define BPP             2
 #define MIN(x, y)       (((x) < (y)) ? (x) : (y))
-#define MAX_BUFFERS     3
+/* capture queue depth, set per session with camera.buffers */
+#define MIN_BUFFERS     2
+#define DEFAULT_BUFFERS 3
+#define MAX_BUFFERS     8
 
 #define V4L2_PIX_FMT_YVYU           v4l2_fourcc('Y', 'V', 'Y', 'U')
 
@@ -82,11 +92,29 @@ namespace android {
 #define MAX_BACK_CAMERA_SNAPSHOT_WIDTH 640
 #define MAX_BACK_CAMERA_SNAPSHOT_HEIGHT 480
 
+/* a sensor behind a video node, in the order they are discovered */
+struct ISI_node {
+    char    path[32];
+    char    name[32];       /* of the input, as the driver reports it */
+    int     input;
+    bool    front;          /* camera.<id>.facing, default back then front */
+    int     orientation;    /* camera.<id>.orientation */
+};
+
 struct ISI_buffer {
     void    *start;
     size_t  length;
 };
 
+/* a sensor control driven by the software AE/AWB loop */
+struct ISI_control {
+    unsigned int id;
+    int     supported;
+    int     value;
+    int     min;
+    int     max;
+};
+
 /* We use this struct as the v4l2_streamparm raw_data for
  * VIDIOC_G_PARM and VIDIOC_S_PARM
  */
@@ -103,9 +131,19 @@ enum v4l2_focusmode {
     FOCUS_MODE_MACRO_DEFAULT,
     FOCUS_MODE_FACEDETECT_DEFAULT,
     FOCUS_MODE_INFINITY,
+    FOCUS_MODE_FIXED,
     FOCUS_MODE_MAX,
 };
 
+enum v4l2_whitebalance {
+    WHITE_BALANCE_AUTO = 0,
+    WHITE_BALANCE_INCANDESCENT,
+    WHITE_BALANCE_FLUORESCENT,
+    WHITE_BALANCE_DAYLIGHT,
+    WHITE_BALANCE_CLOUDY_DAYLIGHT,
+    WHITE_BALANCE_MAX,
+};
+
 class V4L2Camera {
 
 public:
@@ -118,12 +156,15 @@ public:
     V4L2Camera();
     ~V4L2Camera();
 
+    /* one per opened camera, the caller deletes it */
     static V4L2Camera* createInstance(void)
     {
-        static V4L2Camera singleton;
-        return &singleton;
+        return new V4L2Camera();
     }
 
+    static int      getNumberOfCameras(void);
+    static const struct ISI_node *getCameraNode(int camera_id);
+
     int             initCamera(int index);
     void           resetCamera();
     void           DeinitCamera();
@@ -134,12 +175,17 @@ public:
 
     int             startPreview(void);
     int             stopPreview(void);
-    int             getPreviewframe();
+    int             getPreviewframe(nsecs_t *timestamp = NULL);
     int	       freePreviewframe(int index);
     int             setPreviewSize(int width, int height, int pixel_format);
+    int             tryPreviewSize(int width, int height, int pixel_format);
+    int             switchPreview(int width, int height, int pixel_format);
     int             getPreviewSize(int *width, int *height, int *frame_size);
     int             getPreviewMaxSize(int *width, int *height);
     int             getPreviewPixelFormat(void);
+    int             setBufferCount(int count);
+    int             getBufferCount(void);
+    int             getDroppedFrames(void);
 
     int             startRecord(void);
     int             stopRecord(void);
@@ -156,6 +202,16 @@ public:
 
     int             SetRotate(int angle);
     int             getRotate(void);
+    int             setWhiteBalance(int white_balance);
+    int             getWhiteBalance(void);
+    int             setFocusMode(int focus_mode);
+    int             getFocusMode(void);
+    bool            hasControl(unsigned int id);
+    int             getControlRange(unsigned int id, int *min, int *max, int *step);
+    int             setControl(unsigned int id, int value);
+    int             getControl(unsigned int id, int *value);
+    bool            autoExposureEnabled(void);
+    bool            updateAutoExposure(const struct yuyv_stats *stats);
     int             zoomIn(void);
     int             zoomOut(void);
     int             setZoom(int zoom_level);
@@ -178,6 +234,8 @@ private:
     int             m_cam_fd;
     int             m_angle;
     int             m_zoom_level;
+    int             m_white_balance;
+    int             m_focus_mode;
     int             m_flag_camera_start;
     int             m_flag_record_start;
 
@@ -193,8 +251,31 @@ private:
     int             m_snapshot_max_width;
     int             m_snapshot_max_height;
 
+    int             m_buffer_count;         /* buffers the driver gave us */
+    int             m_requested_buffers;    /* for the next start or switch */
+    unsigned int    m_sequence;
+    bool            m_sequence_valid;
+    int             m_dropped_frames;
+    int             requestPreviewBuffers(void);
+
+    /* software AE/AWB for sensors without an ISP */
+    struct ISI_control m_ae_exposure;
+    struct ISI_control m_ae_gain;
+    struct ISI_control m_awb_red;
+    struct ISI_control m_awb_blue;
+    int             m_ae_enabled;
+    int             m_awb_enabled;
+    int             m_ae_wait;
+    bool            m_ae_converged;
+    void            initAutoExposure(void);
+    int             initControl(struct ISI_control *ctrl, unsigned int id);
+    int             scaleControl(struct ISI_control *ctrl, int ratio);
+    int             stepControl(struct ISI_control *ctrl, int delta);
+
     struct       pollfd   m_events_c;
     struct       ISI_buffer m_capture_buf;
+    nsecs_t         m_snapshot_timestamp;   /* monotonic, for EXIF */
+    int             setupSnapshotBuffer(void);
     inline int      m_frameSize(int format, int width, int height);
 
     /* RGB->YUV conversion */
@@ -18,6 +18,7 @@
 /** class CCRGB16toYUV420.cpp
 */
 #include "ccrgb16toyuv420.h"
+#include "cctables.h"
 
 OSCL_EXPORT_REF CCRGB16toYUV420* CCRGB16toYUV420 :: New()
 {
@@ -30,78 +31,71 @@ OSCL_EXPORT_REF CCRGB16toYUV420* CCRGB16toYUV420 :: New()
 CCRGB16toYUV420::CCRGB16toYUV420()
 {
     _mInitialized = false;
+    iColOffset = NULL;
+    iRowOffset = NULL;
 }
 
 
 OSCL_EXPORT_REF CCRGB16toYUV420 :: ~CCRGB16toYUV420()
 {
 // add destructor code here
-    if (_mInitialized == true)
-    {
-        freeRGB2YUVTables();
-    }
+    freeOffsetTables();
 }
 
 
-void CCRGB16toYUV420::freeRGB2YUVTables()
+void CCRGB16toYUV420::freeOffsetTables()
 {
-    if (iY_Table) free(iY_Table);
-    if (iCb_Table) free(iCb_Table);
-    if (iCr_Table) free(iCr_Table);
-    iY_Table  = NULL;
-    iCb_Table = iCr_Table = ipCb_Table = ipCr_Table = NULL;
-
+    if (iColOffset) free(iColOffset);
+    if (iRowOffset) free(iRowOffset);
+    iColOffset = iRowOffset = NULL;
 }
 
 
-int32 CCRGB16toYUV420:: Init(int32 Src_width, int32 Src_height, int32 Src_pitch, int32 Dst_width,
-                             int32 Dst_height, int32 Dst_pitch, int32 nRotation)
+/* Nearest source sample for each destination position, centre aligned. */
+static void build_sample_map(int32 *map, int32 dst_len, int32 src_len,
+                             int32 scale, bool reverse)
 {
-    int i;
-    uint8 *pTable;
-    if ((Src_width != Dst_width) || (Src_height != Dst_height) || (nRotation != 0 && nRotation != CCBOTTOM_UP))
-    {
-        return 0;
-    }
-
-    iBottomUp = false;
-    if (nRotation == CCBOTTOM_UP)
-    {
-        iBottomUp = true;
-    }
+    int32 i, src;
 
-    if (_mInitialized == true)
+    for (i = 0; i < dst_len; i++)
     {
-        freeRGB2YUVTables();
-        _mInitialized = false;
+        src = ((2 * i + 1) * src_len) / (2 * dst_len);
+        if (reverse)
+            src = src_len - 1 - src;
+        map[i] = src * scale;
     }
+}
 
-    /* memory allocation */
-    if ((iY_Table = (uint8*)malloc(384)) == NULL)
-        return 0;
-
-    if ((iCb_Table = (uint8*)malloc(768 * 2)) == NULL)
-        return 0;
 
-    if ((iCr_Table = (uint8*)malloc(768 * 2)) == NULL)
+int32 CCRGB16toYUV420:: Init(int32 Src_width, int32 Src_height, int32 Src_pitch, int32 Dst_width,
+                             int32 Dst_height, int32 Dst_pitch, int32 nRotation)
+{
+    int32 rotation = nRotation & (CCROTATE_CLKWISE | CCFLIP);
+    bool bottomUp = (nRotation & CCBOTTOM_UP) ? true : false;
+    bool swap = (rotation & 1) ? true : false;  /* 90 or 270 degrees */
+    int32 unrot_width, unrot_height;
+    bool flipX, flipY;
+
+    if ((nRotation & ~(CCROTATE_CLKWISE | CCFLIP | CCBOTTOM_UP)) ||
+            (Dst_width & 1) || (Dst_height & 1) ||
+            Dst_width <= 0 || Dst_height <= 0 ||
+            Src_width <= 0 || Src_height <= 0 ||
+            Dst_pitch < Dst_width || Src_pitch < Src_width)
+    {
         return 0;
+    }
 
-#define pv_max(a, b)    ((a) >= (b) ? (a) : (b))
-#define pv_min(a, b)    ((a) <= (b) ? (a) : (b))
-
-    /* Table generation */
-    for (i = 0; i < 384; i++)
-        iY_Table[i] = (uint8) pv_max(pv_min(255, (int32)(0.7152 * i + 16 + 0.5)), 0);
+    /* the tables are built at compile time, see cctables.cpp */
+    iY_Table = cc_rgb16_y_table;
+    ipCb_Table = &CC_RGB16_CB(0);
+    ipCr_Table = &CC_RGB16_CR(0);
 
-    pTable = iCb_Table + 384;
-    for (i = -384; i < 384; i++)
-        pTable[i] = (uint8) pv_max(pv_min(255, (int32)(0.386 * i + 128 + 0.5)), 0);
-    ipCb_Table = iCb_Table + 384;
+    freeOffsetTables();
 
-    pTable = iCr_Table + 384;
-    for (i = -384; i < 384; i++)
-        pTable[i] = (uint8) pv_max(pv_min(255, (int32)(0.454 * i + 128 + 0.5)), 0);
-    ipCr_Table = iCr_Table + 384;
+    iBottomUp = bottomUp;
+    _mRotation = nRotation;
+    _mIsZoom = (Src_width != (swap ? Dst_height : Dst_width)) ||
+               (Src_height != (swap ? Dst_width : Dst_height));
 
     _mSrc_width  = Src_width;
     _mSrc_height = Src_height;
@@ -114,7 +108,67 @@ int32 CCRGB16toYUV420:: Init(int32 Src_width, int32 Src_height, int32 Src_pitch,
     mUseColorKey = false;
     _mInitialized = true;
 
-    SetMode(0); // called after init
+    if (!_mIsZoom && (nRotation & ~CCBOTTOM_UP) == 0)
+    {
+        SetMode(0); // called after init
+        return 1;
+    }
+
+    /* Scaling and/or rotation: every destination pixel reads the source
+     * at iRowOffset[y] + iColOffset[x], which holds for all the supported
+     * orientations, so the conversion stays a single pass over the output.
+     * Dst_width and Dst_height are the size of the output as displayed.
+     */
+    iColOffset = (int32*)malloc(Dst_width * sizeof(int32));
+    iRowOffset = (int32*)malloc(Dst_height * sizeof(int32));
+    if (iColOffset == NULL || iRowOffset == NULL)
+    {
+        freeOffsetTables();
+        _mInitialized = false;
+        return 0;
+    }
+
+    unrot_width = swap ? Dst_height : Dst_width;
+    unrot_height = swap ? Dst_width : Dst_height;
+
+    /* which source axes are walked backwards */
+    switch (rotation & CCROTATE_CLKWISE)
+    {
+        case CCROTATE_CNTRCLKWISE:
+            flipX = true;
+            flipY = false;
+            break;
+        case CCROTATE_180:
+            flipX = true;
+            flipY = true;
+            break;
+        case CCROTATE_CLKWISE:
+            flipX = false;
+            flipY = true;
+            break;
+        default:
+            flipX = false;
+            flipY = false;
+            break;
+    }
+    if (rotation & CCFLIP)
+        flipX = !flipX;
+    if (bottomUp)
+        flipY = !flipY;
+
+    if (swap)
+    {
+        /* output rows walk the source columns and vice versa */
+        build_sample_map(iRowOffset, unrot_width, Src_width, 1, flipX);
+        build_sample_map(iColOffset, unrot_height, Src_height, Src_pitch, flipY);
+    }
+    else
+    {
+        build_sample_map(iColOffset, unrot_width, Src_width, 1, flipX);
+        build_sample_map(iRowOffset, unrot_height, Src_height, Src_pitch, flipY);
+    }
+
+    SetMode(1);
     return 1;
 }
 
@@ -123,7 +177,7 @@ int32 CCRGB16toYUV420::GetOutputBufferSize(void)
 {
     OSCL_ASSERT(_mInitialized == true);
 
-    return ((((_mSrc_width + 15) >> 4) << 4) *(((_mSrc_height + 15) >> 4) << 4) * 3 / 2);
+    return ((((_mDst_width + 15) >> 4) << 4) *(((_mDst_height + 15) >> 4) << 4) * 3 / 2);
 }
 
 
@@ -131,10 +185,12 @@ int32 CCRGB16toYUV420::SetMode(int32 nMode)
 {
     OSCL_ASSERT(_mInitialized == true);
 
-    if (nMode == 1) // do not allow scaling nor rotation
+    if (nMode == 1)
     {
+        if (iColOffset == NULL) // nothing to scale nor rotate
+            return 0;
         _mState = 1;
-        return 0;
+        return 1;
     }
     else
     {
@@ -168,14 +224,16 @@ int32 CCRGB16toYUV420::SetYuvFullRange(bool range)
 
 extern "C"
 {
-    int32 ccrgb16toyuv(uint8 *rgb16, uint8 *yuv[], uint32 *param, uint8 *table[]);
-    int32 ccrgb16toyuv_wo_colorkey(uint8 *rgb16, uint8 *yuv[], uint32 *param, uint8 *table[]);
+    int32 ccrgb16toyuv(uint8 *rgb16, uint8 *yuv[], uint32 *param, const uint8 *table[]);
+    int32 ccrgb16toyuv_wo_colorkey(uint8 *rgb16, uint8 *yuv[], uint32 *param, const uint8 *table[]);
+    int32 ccrgb16toyuv_scale_rotate(uint8 *rgb16, uint8 *yuv[], uint32 *param, const uint8 *table[],
+                                    const int32 *offset[]);
 }
 
 int32 CCRGB16toYUV420::Convert(uint8 *rgb16, uint8 *yuv420)
 {
     uint32 param[7];
-    uint8 *table[3];
+    const uint8 *table[3];
     int32 size16 = _mDst_pitch * _mDst_mheight;
     uint8 *yuv[3];
 
@@ -199,7 +257,12 @@ int32 CCRGB16toYUV420::Convert(uint8 *rgb16, uint8 *yuv420)
     yuv[1] = yuv420 + size16;
     yuv[2] = yuv[1] + (size16 >> 2);
 
-    if (mUseColorKey == true)
+    if (_mState == 1)
+    {
+        const int32 *offset[2] = { iColOffset, iRowOffset };
+        return ccrgb16toyuv_scale_rotate(rgb16, yuv, param, table, offset);
+    }
+    else if (mUseColorKey == true)
     {
         return ccrgb16toyuv(rgb16, yuv, param, table);
     }
@@ -211,14 +274,13 @@ int32 CCRGB16toYUV420::Convert(uint8 *rgb16, uint8 *yuv420)
 
 int16 CCRGB16toYUV420::GetCapability()
 {
-    /* Not implement */
-    return static_cast <int16>(0);
+    return static_cast <int16>(CCSUPPORT_ROTATION | CCSUPPORT_SCALING);
 }
 
 extern "C"
 {
 
-    int32 ccrgb16toyuv(uint8 *rgb16, uint8 *yuv[], uint32 *param, uint8 *table[])
+    int32 ccrgb16toyuv(uint8 *rgb16, uint8 *yuv[], uint32 *param, const uint8 *table[])
     {
         uint16 *inputRGB = (uint16*)rgb16;
         int32 width_dst = param[0];
@@ -226,9 +288,9 @@ extern "C"
         int32 pitch_dst = param[2];
         int32 pitch_src = param[4];
         uint16 colorkey = param[5];
-        uint8 *y_tab = table[0];
-        uint8 *cb_tab = table[1];
-        uint8 *cr_tab = table[2];
+        const uint8 *y_tab = table[0];
+        const uint8 *cb_tab = table[1];
+        const uint8 *cr_tab = table[2];
 
         int32 i, j, count;
         int32 ilimit, jlimit;
@@ -384,7 +446,7 @@ extern "C"
     }
 
 
-    int32 ccrgb16toyuv_wo_colorkey(uint8 *rgb16, uint8 *yuv[], uint32 *param, uint8 *table[])
+    int32 ccrgb16toyuv_wo_colorkey(uint8 *rgb16, uint8 *yuv[], uint32 *param, const uint8 *table[])
     {
         uint16 *inputRGB = (uint16*)rgb16;
         int32 width_dst = param[0];
@@ -392,9 +454,9 @@ extern "C"
         int32 pitch_dst = param[2];
         int32 pitch_src = param[4];
         uint32 iBottomUp = param[6];
-        uint8 *y_tab = table[0];
-        uint8 *cb_tab = table[1];
-        uint8 *cr_tab = table[2];
+        const uint8 *y_tab = table[0];
+        const uint8 *cb_tab = table[1];
+        const uint8 *cr_tab = table[2];
 
         int32 i, j, count;
         int32 ilimit, jlimit;
@@ -417,7 +479,7 @@ extern "C"
 
         if (iBottomUp == 1)
         {
-            inputRGB += (jlimit - 1) * width_dst; // move to last row
+            inputRGB += (jlimit - 1) * pitch_src; // move to last row
             pitch_src = -pitch_src;
         }
 
@@ -494,13 +556,89 @@ extern "C"
         return 1;
     }
 
+
+    /* One pass over the destination: each 2x2 output block samples four
+     * source pixels through the offset tables built in Init(), writes their
+     * luma and averages them for the chroma, same as the 1:1 kernels.
+     * The colour key is not applied here.
+     */
+    int32 ccrgb16toyuv_scale_rotate(uint8 *rgb16, uint8 *yuv[], uint32 *param, const uint8 *table[],
+                                    const int32 *offset[])
+    {
+        uint16 *inputRGB = (uint16*)rgb16;
+        int32 width_dst = param[0];
+        int32 height_dst = param[1];
+        int32 pitch_dst = param[2];
+        const uint8 *y_tab = table[0];
+        const uint8 *cb_tab = table[1];
+        const uint8 *cr_tab = table[2];
+        const int32 *col_ofs = offset[0];
+        const int32 *row_ofs = offset[1];
+
+        int32 i, j, k;
+        uint8 *tempY, *tempU, *tempV;
+        uint16 *row0, *row1;
+        uint16 pixels[4];
+        int32 R_ds; /* "_ds" is the downsample version */
+        int32 G_ds; /* "_ds" is the downsample version */
+        int32 B_ds; /* "_ds" is the downsample version */
+        int   tmp;
+        uint32 temp;
+
+        tempY = yuv[0];
+        tempU = yuv[1];
+        tempV = yuv[2];
+
+        for (j = 0; j < height_dst; j += 2)
+        {
+            row0 = inputRGB + row_ofs[j];
+            row1 = inputRGB + row_ofs[j + 1];
+
+            for (i = 0; i < width_dst; i += 2)
+            {
+                pixels[0] = row0[col_ofs[i]];
+                pixels[1] = row0[col_ofs[i + 1]];
+                pixels[2] = row1[col_ofs[i]];
+                pixels[3] = row1[col_ofs[i + 1]];
+
+                G_ds = B_ds = R_ds = 0;
+                for (k = 0; k < 4; k++)
+                {
+                    temp = (ALPHA * (pixels[k] & 0x001F) + BETA * (pixels[k] >> 11));
+                    tempY[(k >> 1) * pitch_dst + (k & 1)] =
+                        y_tab[(temp>>SHIFT_INDEX1) + ((pixels[k]>>3) & 0x00FC)];
+
+                    G_ds    += (pixels[k] >> 1) & 0x03E0;
+                    B_ds    += (pixels[k] << 5) & 0x03E0;
+                    R_ds    += (pixels[k] >> 6) & 0x03E0;
+                }
+                tempY += 2;
+
+                R_ds >>= 2;
+                B_ds >>= 2;
+                G_ds >>= 2;
+
+                tmp = B_ds - R_ds;
+
+                *tempU++ = cb_tab[(((B_ds-G_ds)<<16) + 19525*tmp)>>18];
+                *tempV++ = cr_tab[(((R_ds-G_ds)<<16) -  6640*tmp)>>18];
+            }
+
+            tempY += (pitch_dst - width_dst) + pitch_dst;
+            tempU += ((pitch_dst - width_dst)) >> 1;
+            tempV += ((pitch_dst - width_dst)) >> 1;
+        }
+
+        return 1;
+    }
+
 }
 
 // in this overload, yuv420 is the output, rgb16 is input
 int32 CCRGB16toYUV420::Convert(uint8 *rgb16, uint8 **yuv420)
 {
-    uint32 param[6];
-    uint8 *table[3];
+    uint32 param[7];
+    const uint8 *table[3];
 
     OSCL_ASSERT(rgb16);
     OSCL_ASSERT(yuv420);
@@ -515,12 +653,18 @@ int32 CCRGB16toYUV420::Convert(uint8 *rgb16, uint8 **yuv420)
     param[3] = (uint32) _mDst_mheight;
     param[4] = (uint32) _mSrc_pitch;
     param[5] = (uint32) mColorKey;
+    param[6] = (uint32) iBottomUp;
 
     table[0] = iY_Table;
     table[1] = ipCb_Table;
     table[2] = ipCr_Table;
 
-    if (mUseColorKey == true)
+    if (_mState == 1)
+    {
+        const int32 *offset[2] = { iColOffset, iRowOffset };
+        return ccrgb16toyuv_scale_rotate(rgb16, yuv420, param, table, offset);
+    }
+    else if (mUseColorKey == true)
     {
         return ccrgb16toyuv(rgb16, yuv420, param, table);
     }
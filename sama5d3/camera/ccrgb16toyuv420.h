@@ -45,10 +45,12 @@ public:
         *   @param Dst_height specifies the height in pixel of the output.
         *   @param Dst_pitch is the stride size of the destination memory.
         *   @param nRotation specifies whether rotation is to be applied. The value can be one of the followings
-        *   CCROTATE_NONE (0), CCROTATE_CNTRCLKWISE (1) or CCROTATE_CLKWISE (3).
-        *   When rotation is chosen, the Dst_width and Dst_height is still relative to the source coordinate,
+        *   CCROTATE_NONE (0), CCROTATE_CNTRCLKWISE (1), CCROTATE_180 (2) or CCROTATE_CLKWISE (3),
+        *   optionally or'ed with CCFLIP and CCBOTTOM_UP.
+        *   Dst_width and Dst_height are the size of the output as displayed,
         *   i.e., to rotate a QCIF image, the output width will be 144 and height will be 176.
-        *   @return It returns 1 if success, 0 if fail, i.e.any of the above parameters is an odd number.
+        *   Scaling uses the nearest source pixel and is done in the same pass as the rotation.
+        *   @return It returns 1 if success, 0 if fail, i.e.any of the destination sizes is an odd number.
     */
     int32 Init(int32 Src_width,
                int32 Src_height,
@@ -126,13 +128,13 @@ public:
 private:
 
     /**
-     @brief This function frees the memory allocated for the YUV tables
+     @brief This function frees the source offset tables used for scaling and rotation
     */
-    void freeRGB2YUVTables();
+    void freeOffsetTables();
 
-    /** @brief  Tables in color coversion */
-    uint8   *iY_Table, *iCb_Table, *iCr_Table;
-    uint8   *ipCb_Table, *ipCr_Table;
+    /** @brief  Tables in color coversion, shared read-only (cctables.h) */
+    const uint8 *iY_Table;
+    const uint8 *ipCb_Table, *ipCr_Table;
 
     /** @brief  Memory height of the output YUV420 image, default to mDstHeight. **/
     int32 _mDst_mheight;
@@ -145,6 +147,10 @@ private:
 
     bool    iBottomUp;
 
+    /** @brief  Source offset, in pixels, of each output column and row. Only
+     *  allocated when Init() is asked to scale or rotate. **/
+    int32   *iColOffset, *iRowOffset;
+
 };
 
 #endif // CCRGB16TOYUV420_H_INCLUDED
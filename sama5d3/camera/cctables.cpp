@@ -0,0 +1,65 @@
+/*
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License
+*/
+
+#include "cctables.h"
+
+/* Expand f(i) for i = base .. base + n - 1. Each entry is an arithmetic
+ * constant expression, so the tables are folded by the compiler with the
+ * same double precision math the converters used to run at Init().
+ */
+#define CC_REP4(f, i)   f(i), f((i) + 1), f((i) + 2), f((i) + 3)
+#define CC_REP16(f, i)  CC_REP4(f, i), CC_REP4(f, (i) + 4), \
+                        CC_REP4(f, (i) + 8), CC_REP4(f, (i) + 12)
+#define CC_REP64(f, i)  CC_REP16(f, i), CC_REP16(f, (i) + 16), \
+                        CC_REP16(f, (i) + 32), CC_REP16(f, (i) + 48)
+#define CC_REP128(f, i) CC_REP64(f, i), CC_REP64(f, (i) + 64)
+#define CC_REP256(f, i) CC_REP128(f, i), CC_REP128(f, (i) + 128)
+
+#define CC_SAT(v)       ((v) > 255 ? 255 : ((v) < 0 ? 0 : (v)))
+
+#define CC_Y(i)         (uint8_t)CC_SAT((int32_t)(0.7152 * (i) + 16 + 0.5))
+#define CC_CB(i)        (uint8_t)CC_SAT((int32_t)(0.386 * (i) + 128 + 0.5))
+#define CC_CR(i)        (uint8_t)CC_SAT((int32_t)(0.454 * (i) + 128 + 0.5))
+
+const uint8_t cc_rgb16_y_table[384] = {
+    CC_REP256(CC_Y, 0), CC_REP128(CC_Y, 256)
+};
+
+const uint8_t cc_rgb16_cb_table[768] = {
+    CC_REP256(CC_CB, -384), CC_REP256(CC_CB, -128), CC_REP256(CC_CB, 128)
+};
+
+const uint8_t cc_rgb16_cr_table[768] = {
+    CC_REP256(CC_CR, -384), CC_REP256(CC_CR, -128), CC_REP256(CC_CR, 128)
+};
+
+#define CC_YUV_Y(i)     (1192 * ((i) - 16))
+#define CC_YUV_RV(i)    (1634 * ((i) - 128))
+#define CC_YUV_GV(i)    (833 * ((i) - 128))
+#define CC_YUV_GU(i)    (400 * ((i) - 128))
+#define CC_YUV_BU(i)    (2066 * ((i) - 128))
+
+const int32_t cc_yuv_y_table[256] = { CC_REP256(CC_YUV_Y, 0) };
+const int32_t cc_yuv_rv_table[256] = { CC_REP256(CC_YUV_RV, 0) };
+const int32_t cc_yuv_gv_table[256] = { CC_REP256(CC_YUV_GV, 0) };
+const int32_t cc_yuv_gu_table[256] = { CC_REP256(CC_YUV_GU, 0) };
+const int32_t cc_yuv_bu_table[256] = { CC_REP256(CC_YUV_BU, 0) };
+
+#define CC_CLIP_ENTRY(i)    (uint8_t)CC_SAT(i)
+
+const uint8_t cc_clip_table[1024] = {
+    CC_REP256(CC_CLIP_ENTRY, -384), CC_REP256(CC_CLIP_ENTRY, -128),
+    CC_REP256(CC_CLIP_ENTRY, 128), CC_REP256(CC_CLIP_ENTRY, 384)
+};
@@ -0,0 +1,48 @@
+/*
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License
+*/
+
+#ifndef CCTABLES_H_INCLUDED
+#define CCTABLES_H_INCLUDED
+
+#include <stdint.h>
+
+/* Colour conversion lookup tables used by the camera. They are constant
+ * initialised, so the compiler evaluates them and they end up in .rodata,
+ * shared by every process that maps the HAL. Nothing to build at run time.
+ */
+
+/* RGB565 -> YUV (BT.709), see CCRGB16toYUV420 */
+extern const uint8_t cc_rgb16_y_table[384];
+extern const uint8_t cc_rgb16_cb_table[768];    /* index -384..383 */
+extern const uint8_t cc_rgb16_cr_table[768];    /* index -384..383 */
+
+#define CC_RGB16_CB(x)  (cc_rgb16_cb_table[(x) + 384])
+#define CC_RGB16_CR(x)  (cc_rgb16_cr_table[(x) + 384])
+
+/* YUV -> RGB, 10 bit fixed point:
+ *   r = (y + rv) >> 10, g = (y - gv - gu) >> 10, b = (y + bu) >> 10
+ */
+extern const int32_t cc_yuv_y_table[256];       /* 1192 * (Y - 16) */
+extern const int32_t cc_yuv_rv_table[256];      /* 1634 * (V - 128) */
+extern const int32_t cc_yuv_gv_table[256];      /*  833 * (V - 128) */
+extern const int32_t cc_yuv_gu_table[256];      /*  400 * (U - 128) */
+extern const int32_t cc_yuv_bu_table[256];      /* 2066 * (U - 128) */
+
+/* clamp to 0..255, covers every r, g and b the tables above produce */
+extern const uint8_t cc_clip_table[1024];       /* index -384..639 */
+
+#define CC_CLIP(x)      (cc_clip_table[(x) + 384])
+
+#endif
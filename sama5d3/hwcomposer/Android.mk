@@ -23,7 +23,7 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_SHARED_LIBRARIES := libcutils liblog libEGL
 LOCAL_MODULE_TAGS := optional
 LOCAL_PRELINK_MODULE := false
-LOCAL_SRC_FILES := hwcomposer.cpp SamHWCutils.cpp v4l2_utils.cpp
+LOCAL_SRC_FILES := hwcomposer.cpp SamHWCutils.cpp SamHWCblit.cpp SamHWCplan.cpp v4l2_utils.cpp
 LOCAL_MODULE := hwcomposer.$(TARGET_BOOTLOADER_BOARD_NAME)
 LOCAL_CFLAGS:= -DLOG_TAG=\"hwcomposer\"
 LOCAL_C_INCLUDES += device/atmel/common/hardware/sama5d3/libgralloc
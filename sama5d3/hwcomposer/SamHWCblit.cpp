@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "SamHWCblit.h"
+
+#define BLIT_BATCH      64      /* bytes per run of stores, two WC lines */
+#define BLIT_PREFETCH   256     /* how far ahead the source is fetched */
+
+typedef void (*copy_row_fn)(uint8_t *d, const uint8_t *s, size_t n);
+
+static void copy_row_memcpy(uint8_t *d, const uint8_t *s, size_t n)
+{
+    memcpy(d, s, n);
+}
+
+/* bytes up to the next batch boundary of the destination */
+static inline size_t batch_head(const uint8_t *d, size_t n)
+{
+    size_t head = (BLIT_BATCH - ((uintptr_t)d & (BLIT_BATCH - 1))) & (BLIT_BATCH - 1);
+
+    return head < n ? head : n;
+}
+
+/*
+ * Whole batches of aligned words, as ldm/stm pairs. Sources that can't be
+ * word aligned together with the destination go to memcpy.
+ */
+static void copy_row_words(uint8_t *d, const uint8_t *s, size_t n)
+{
+    size_t head = batch_head(d, n);
+
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    if (!((uintptr_t)s & 3)) {
+        uint32_t *dw = (uint32_t *)d;
+        const uint32_t *sw = (const uint32_t *)s;
+
+        for (; n >= BLIT_BATCH; n -= BLIT_BATCH) {
+            __builtin_prefetch((const uint8_t *)sw + BLIT_PREFETCH);
+            for (int i = 0; i < BLIT_BATCH / 4; i += 8) {
+                uint32_t w0 = sw[i], w1 = sw[i + 1], w2 = sw[i + 2], w3 = sw[i + 3];
+                uint32_t w4 = sw[i + 4], w5 = sw[i + 5], w6 = sw[i + 6], w7 = sw[i + 7];
+
+                dw[i] = w0; dw[i + 1] = w1; dw[i + 2] = w2; dw[i + 3] = w3;
+                dw[i + 4] = w4; dw[i + 5] = w5; dw[i + 6] = w6; dw[i + 7] = w7;
+            }
+            sw += BLIT_BATCH / 4;
+            dw += BLIT_BATCH / 4;
+        }
+        d = (uint8_t *)dw;
+        s = (const uint8_t *)sw;
+    }
+
+    memcpy(d, s, n);
+}
+
+#if defined(__ARM_NEON__)
+/* four q registers per batch, any source alignment */
+static void copy_row_neon(uint8_t *d, const uint8_t *s, size_t n)
+{
+    size_t head = batch_head(d, n);
+
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    for (; n >= BLIT_BATCH; n -= BLIT_BATCH) {
+        __builtin_prefetch(s + BLIT_PREFETCH);
+        uint8x16_t q0 = vld1q_u8(s);
+        uint8x16_t q1 = vld1q_u8(s + 16);
+        uint8x16_t q2 = vld1q_u8(s + 32);
+        uint8x16_t q3 = vld1q_u8(s + 48);
+
+        vst1q_u8(d, q0);
+        vst1q_u8(d + 16, q1);
+        vst1q_u8(d + 32, q2);
+        vst1q_u8(d + 48, q3);
+        s += BLIT_BATCH;
+        d += BLIT_BATCH;
+    }
+
+    memcpy(d, s, n);
+}
+
+#ifndef AT_HWCAP
+#define AT_HWCAP        16
+#endif
+#ifndef HWCAP_NEON
+#define HWCAP_NEON      (1 << 12)
+#endif
+
+/* built for NEON, but the core may still lack it */
+static bool cpu_has_neon(void)
+{
+    unsigned long aux[2];
+    bool neon = true;   /* the rest of the build assumes it anyway */
+    int fd = open("/proc/self/auxv", O_RDONLY);
+
+    if (fd < 0)
+        return neon;
+    while (read(fd, aux, sizeof(aux)) == (ssize_t)sizeof(aux) && aux[0]) {
+        if (aux[0] == AT_HWCAP) {
+            neon = (aux[1] & HWCAP_NEON) != 0;
+            break;
+        }
+    }
+    close(fd);
+    return neon;
+}
+#endif
+
+static inline void blit_with(copy_row_fn copy_row,
+                             void *dst, size_t dst_pitch,
+                             const void *src, size_t src_pitch,
+                             size_t row_bytes, int rows)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (rows <= 0 || !row_bytes)
+        return;
+
+    if (dst_pitch == row_bytes && src_pitch == row_bytes) {
+        copy_row(d, s, row_bytes * rows);
+        return;
+    }
+
+    while (rows-- > 0) {
+        /* the next row starts coming in while this one is stored */
+        if (rows)
+            __builtin_prefetch(s + src_pitch);
+        copy_row(d, s, row_bytes);
+        d += dst_pitch;
+        s += src_pitch;
+    }
+}
+
+static void blit_memcpy(void *dst, size_t dst_pitch, const void *src,
+                        size_t src_pitch, size_t row_bytes, int rows)
+{
+    blit_with(copy_row_memcpy, dst, dst_pitch, src, src_pitch, row_bytes, rows);
+}
+
+static void blit_words(void *dst, size_t dst_pitch, const void *src,
+                       size_t src_pitch, size_t row_bytes, int rows)
+{
+    blit_with(copy_row_words, dst, dst_pitch, src, src_pitch, row_bytes, rows);
+}
+
+#if defined(__ARM_NEON__)
+static void blit_neon(void *dst, size_t dst_pitch, const void *src,
+                      size_t src_pitch, size_t row_bytes, int rows)
+{
+    blit_with(copy_row_neon, dst, dst_pitch, src, src_pitch, row_bytes, rows);
+}
+#endif
+
+void sam_blit_rows_swap_rb(void *dst, size_t dst_pitch,
+                           const void *src, size_t src_pitch,
+                           int width, int rows)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+
+    for (; rows > 0; rows--, d += dst_pitch, s += src_pitch) {
+        int x = 0;
+
+        if (!(((uintptr_t)d | (uintptr_t)s) & 3)) {
+            uint32_t *dw = (uint32_t *)d;
+            const uint32_t *sw = (const uint32_t *)s;
+
+            /* the middle bytes stay, the outer two trade places */
+            for (; x < width; x++) {
+                uint32_t p = sw[x];
+
+                dw[x] = (p & 0xff00ff00) | ((p & 0xff) << 16) | ((p >> 16) & 0xff);
+            }
+        }
+
+        for (; x < width; x++) {
+            d[x * 4] = s[x * 4 + 2];
+            d[x * 4 + 1] = s[x * 4 + 1];
+            d[x * 4 + 2] = s[x * 4];
+            d[x * 4 + 3] = s[x * 4 + 3];
+        }
+    }
+}
+
+static const char * const sEngineNames[SAM_BLIT_ENGINES] = {
+    "auto", "memcpy", "words", "neon",
+};
+
+static sam_blit_fn sBlit;
+
+sam_blit_fn sam_blit_engine(int engine)
+{
+    switch (engine) {
+    case SAM_BLIT_MEMCPY:
+        return blit_memcpy;
+    case SAM_BLIT_WORDS:
+        return blit_words;
+#if defined(__ARM_NEON__)
+    case SAM_BLIT_NEON:
+        return cpu_has_neon() ? blit_neon : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+const char *sam_blit_engine_name(int engine)
+{
+    if (engine < 0 || engine >= SAM_BLIT_ENGINES)
+        return "?";
+    return sEngineNames[engine];
+}
+
+int sam_blit_select(int engine)
+{
+    sam_blit_fn fn = engine != SAM_BLIT_AUTO ? sam_blit_engine(engine) : NULL;
+
+    if (!fn) {
+        engine = SAM_BLIT_NEON;
+        fn = sam_blit_engine(engine);
+    }
+    if (!fn) {
+        engine = SAM_BLIT_WORDS;
+        fn = sam_blit_engine(engine);
+    }
+    sBlit = fn;
+    return engine;
+}
+
+void sam_blit_rows(void *dst, size_t dst_pitch,
+                   const void *src, size_t src_pitch,
+                   size_t row_bytes, int rows)
+{
+    if (!sBlit)
+        sam_blit_select(SAM_BLIT_AUTO);
+    sBlit(dst, dst_pitch, src, src_pitch, row_bytes, rows);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SAM_HWC_BLIT_H_
+#define ANDROID_SAM_HWC_BLIT_H_
+
+#include <stddef.h>
+
+/*
+ * CPU copy of a rectangle between two linear buffers, row_bytes per row,
+ * each side advancing by its own pitch. Done as a single copy when both
+ * sides are contiguous. Shared by the hwcomposer window copies and the
+ * copybit module, and free of Android headers so it builds on the host.
+ */
+void sam_blit_rows(void *dst, size_t dst_pitch,
+                   const void *src, size_t src_pitch,
+                   size_t row_bytes, int rows);
+
+/*
+ * The same for 32bpp pixels with the first and third bytes swapped on the
+ * way, RGBA to BGRA and back, width in pixels.
+ */
+void sam_blit_rows_swap_rb(void *dst, size_t dst_pitch,
+                           const void *src, size_t src_pitch,
+                           int width, int rows);
+
+typedef void (*sam_blit_fn)(void *dst, size_t dst_pitch,
+                            const void *src, size_t src_pitch,
+                            size_t row_bytes, int rows);
+
+/*
+ * The ways sam_blit_rows can copy. The destination is usually framebuffer
+ * memory mapped write-combined, which only goes fast with long runs of
+ * aligned stores; words and neon store whole aligned batches and prefetch
+ * the source ahead. Auto is neon when this core has it, words otherwise.
+ */
+enum {
+    SAM_BLIT_AUTO = 0,
+    SAM_BLIT_MEMCPY,
+    SAM_BLIT_WORDS,
+    SAM_BLIT_NEON,
+    SAM_BLIT_ENGINES
+};
+
+/* NULL when the build or the CPU lacks it */
+sam_blit_fn sam_blit_engine(int engine);
+const char *sam_blit_engine_name(int engine);
+/* what sam_blit_rows uses from now on, auto if not available */
+int sam_blit_select(int engine);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SamHWCplan.h"
+
+static int64_t gain_ovr(const struct sam_plan_layer *l, int win)
+{
+    return (int64_t)l->gles - l->ovr[win] - l->ovr_reconfig[win];
+}
+
+static int64_t gain_heo(const struct sam_plan_layer *l)
+{
+    return (int64_t)l->gles - l->heo - l->heo_reconfig;
+}
+
+/*
+ * Every way of filling the three windows, at most a few hundred for a full
+ * list. a is the upper OVL layer, b the lower one; -1 for none. Ties keep
+ * the first found, which uses fewer windows and upper layers.
+ */
+int sam_plan_layers(const struct sam_plan_layer *layers, int count,
+                    int num_ovr, int num_heo, int *target)
+{
+    int64_t best = 0;
+    int best_h = -1, best_a = -1, best_b = -1;
+    int placed = 0;
+
+    if (count > SAM_PLAN_MAX_LAYERS)
+        count = SAM_PLAN_MAX_LAYERS;
+    if (num_ovr > SAM_PLAN_MAX_OVR)
+        num_ovr = SAM_PLAN_MAX_OVR;
+
+    for (int h = -1; h < count; h++) {
+        if (h >= 0 && (!num_heo || !(layers[h].can & SAM_PLAN_HEO)))
+            continue;
+        int64_t heo = h >= 0 ? gain_heo(&layers[h]) : 0;
+
+        for (int a = -1; a < count; a++) {
+            if (a >= 0 && (!num_ovr || a == h || !(layers[a].can & SAM_PLAN_OVR)))
+                continue;
+            int64_t upper = a >= 0 ? gain_ovr(&layers[a], num_ovr - 1) : 0;
+
+            /* b == a for no lower layer */
+            for (int b = a; b < count; b++) {
+                if (b > a && (a < 0 || num_ovr < 2 || b == h ||
+                              !(layers[b].can & SAM_PLAN_OVR)))
+                    continue;
+                int64_t score = heo + upper +
+                                (b > a ? gain_ovr(&layers[b], num_ovr - 2) : 0);
+
+                if (score > best) {
+                    best = score;
+                    best_h = h;
+                    best_a = a;
+                    best_b = b > a ? b : -1;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+        target[i] = SAM_PLAN_FB;
+    if (best_h >= 0) {
+        target[best_h] = SAM_PLAN_HEO;
+        placed++;
+    }
+    if (best_a >= 0) {
+        target[best_a] = SAM_PLAN_OVR;
+        placed++;
+    }
+    if (best_b >= 0) {
+        target[best_b] = SAM_PLAN_OVR;
+        placed++;
+    }
+    return placed;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SAM_HWC_PLAN_H_
+#define ANDROID_SAM_HWC_PLAN_H_
+
+#include <stdint.h>
+
+#define SAM_PLAN_MAX_LAYERS 16  /* the topmost ones, the rest stay in GLES */
+#define SAM_PLAN_MAX_OVR    2
+
+/* where a layer goes */
+enum {
+    SAM_PLAN_FB  = 0,
+    SAM_PLAN_OVR = 1 << 0,
+    SAM_PLAN_HEO = 1 << 1,
+};
+
+/*
+ * What a layer costs per frame in bytes moved, each way it can be shown.
+ * The hwcomposer works these out from the layer and the windows; the
+ * planner only adds them up.
+ */
+struct sam_plan_layer {
+    int      can;                           /* SAM_PLAN_OVR | SAM_PLAN_HEO */
+    uint32_t gles;                          /* composing it into fb0 */
+    uint32_t ovr[SAM_PLAN_MAX_OVR];         /* copy and scan-out, per OVL window */
+    uint32_t ovr_reconfig[SAM_PLAN_MAX_OVR];/* the window showing something else */
+    uint32_t heo;
+    uint32_t heo_reconfig;
+};
+
+/*
+ * Picks the windows for layers[0..count-1], topmost first, that save the
+ * most: what GLES would have moved, less what the windows move instead.
+ * OVL windows keep the stacking of their layers, the upper one on window
+ * num_ovr-1. Fills target[] with SAM_PLAN_FB/OVR/HEO and returns the
+ * number of layers on windows.
+ */
+int sam_plan_layers(const struct sam_plan_layer *layers, int count,
+                    int num_ovr, int num_heo, int *target);
+
+#endif /* ANDROID_SAM_HWC_PLAN_H_ */
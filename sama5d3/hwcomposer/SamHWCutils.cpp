@@ -144,7 +144,9 @@ int window_set_pos(struct hwc_win_info_t *win)
     win->var_info.xres = win->rect_info.w;
     win->var_info.yres = win->rect_info.h;
 
-    win->var_info.yoffset = win->lcd_info.yres * win->buf_index;
+    /* otherwise yoffset is already at the client's buffer */
+    if (!win->zero_copy)
+        win->var_info.yoffset = win->lcd_info.yres * win->buf_index;
 
     win->var_info.activate &= ~FB_ACTIVATE_MASK;
     win->var_info.activate |= FB_ACTIVATE_NOW | FB_ACTIVATE_FORCE;
@@ -232,6 +234,42 @@ int window_pan_display(struct hwc_win_info_t *win)
     return 0;
 }
 
+/* scan out from line yoffset of the window's memory */
+int window_pan_to(struct hwc_win_info_t *win, uint32_t yoffset)
+{
+    win->var_info.yoffset = yoffset;
+
+    if (ioctl(win->fd, FBIOPAN_DISPLAY, &(win->var_info)) < 0) {
+        LOGE("%s::FBIOPAN_DISPLAY(fd:%d, yoffset:%d) fail(%s)",
+             __func__, win->fd, yoffset, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+#ifndef FBIO_WAITFORVSYNC
+#define FBIO_WAITFORVSYNC   _IOW('F', 0x20, __u32)
+#endif
+
+/* until the LCDC starts the next frame, on what the last pan gave it */
+int window_wait_vsync(struct hwc_win_info_t *win)
+{
+    __u32 crtc = 0;
+
+    if (ioctl(win->fd, FBIO_WAITFORVSYNC, &crtc) < 0) {
+        LOGE("%s::FBIO_WAITFORVSYNC(fd:%d) fail(%s)",
+             __func__, win->fd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* bytes from one line of the window memory to the next, at the current bpp */
+int window_line_length(struct hwc_win_info_t *win)
+{
+    return win->var_info.xres_virtual * win->var_info.bits_per_pixel / 8;
+}
+
 int window_show(struct hwc_win_info_t *win)
 {
     win->var_info.nonstd |= 1 << 31;
@@ -58,11 +58,18 @@ struct hwc_win_info_t {
     int        blending;
     int        layer_index;
     uint32_t   layer_prev_buf;
+    int32_t    layer_prev_gen;
     int        set_win_flag;
     int        status;
     int        vsync;
     void*    base;
     uint32_t layer_prev_format;
+    int        zero_copy;      /* showing a gralloc overlay buffer in place */
+    int        num_rects;      /* visible rects of the layer, at prepare */
+    int        pending_copy;   /* this frame: 1 to copy, -1 if that failed */
+    int        pending_pan;    /* this frame: yoffset to pan to, or -1 */
+    int        pending_flip;   /* this frame: a layer buffer leaves the screen */
+    int        no_vsync;       /* no FBIO_WAITFORVSYNC, so copies, no panning */
 
     struct fb_fix_screeninfo fix_info;
     struct fb_var_screeninfo var_info;
@@ -82,6 +89,9 @@ int window_hide(struct hwc_win_info_t *win);
 int window_mmap(struct hwc_win_info_t *win);
 int window_munmap(struct hwc_win_info_t *win);
 int window_pan_display(struct hwc_win_info_t *win);
+int window_pan_to(struct hwc_win_info_t *win, uint32_t yoffset);
+int window_wait_vsync(struct hwc_win_info_t *win);
+int window_line_length(struct hwc_win_info_t *win);
 int window_get_global_lcd_info(struct fb_var_screeninfo *lcd_info);
 
 
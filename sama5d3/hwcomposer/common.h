@@ -6,6 +6,7 @@
 #include <cutils/log.h>
 #include <cutils/atomic.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include "linux/fb.h"
@@ -17,7 +18,11 @@
 #define NUM_OF_WIN_BUF      (2)
 
 #define MAX_NUM_OF_HEO (1)
-#define NUM_OF_HEO_BUF (3)
+#define MAX_NUM_OF_RECTS (8)    /* visible rects of a layer on an OVL window */
+#define NUM_OF_HEO_BUF (3)       /* default queue depth, hwc.heo.buffers */
+#define MAX_NUM_OF_HEO_BUF (8)
+#define NUM_OF_HEO_DIRECT_BUF (3)   /* layer buffers in place, on screen and next */
+#define HEO_RELEASE_POLL_MS (100)   /* release_thread, a few frames at most */
 
 struct sam_rect {
     uint32_t x;
@@ -43,6 +48,7 @@ enum {
 
 #include "SamHWCutils.h"
 #include "v4l2_utils.h"
+#include "SamHWCplan.h"
 
 struct hwc_context_t {
     hwc_composer_device_t     device;
@@ -57,6 +63,20 @@ struct hwc_context_t {
     unsigned int              num_of_hwc_layer;
     unsigned int              num_of_hwc_layer_prev;
     unsigned int              num_of_fb_layer_prev;
+
+    /* the last plan, kept while the layers keep their geometry */
+    int                       plan_valid;
+    uint32_t                  plan_signature;
+    int                       plan_target[SAM_PLAN_MAX_LAYERS];
+    int                       plan_gles_weight;
+
+    /* the frame copy_thread is copying, NULL when done */
+    int                       copy_threaded;
+    pthread_t                 copy_thread;
+    pthread_mutex_t           copy_lock;
+    pthread_cond_t            copy_cond;
+    hwc_layer_list_t          *copy_list;
+    int                       copy_exit;
 };
 
 
@@ -26,6 +26,7 @@
 
 #include "common.h"
 #include "gralloc_priv.h"
+#include "SamHWCblit.h"
 
 /*****************************************************************************/
 
@@ -64,10 +65,44 @@ static void dump_layer(hwc_layer_t const* l) {
          l->displayFrame.bottom);
 }
 
+/*
+ * Whether the layer shows what the window got last time: the same buffer,
+ * not written since. Remembers the buffer for the next frame either way.
+ * Buffers without a generation count always count as changed.
+ */
+static bool layer_unchanged(hwc_layer_t *cur_layer,
+                            uint32_t *prev_buf, int32_t *prev_gen)
+{
+    private_handle_t *prev_handle = (private_handle_t *)(cur_layer->handle);
+    int32_t gen;
+
+    if (!(prev_handle->flags & private_handle_t::PRIV_FLAGS_GENERATION) ||
+            !prev_handle->base) {
+        *prev_buf = 0;
+        return false;
+    }
+
+    gen = android_atomic_acquire_load(prev_handle->generation());
+    if (*prev_buf == (uint32_t)prev_handle && *prev_gen == gen)
+        return true;
+
+    *prev_buf = (uint32_t)prev_handle;
+    *prev_gen = gen;
+    return false;
+}
+
+/*
+ * The window spans the bounding box of the layer's visible rects, see
+ * assign_overlay_window; each rect lands at its place in it, one window
+ * line_length apart per row.
+ */
 static int copy_src_content(hwc_layer_t *cur_layer,
                             struct hwc_win_info_t *win,
                             int win_idx)
 {
+    if(MAX_NUM_OF_WIN <= win_idx)
+        return -1;
+
     /* switch to next buffer
       * buf_index will be reset to NUM_OF_WIN_BUF when win be open
       */
@@ -75,39 +110,321 @@ static int copy_src_content(hwc_layer_t *cur_layer,
     	win->buf_index = (win->buf_index + 1) % NUM_OF_WIN_BUF;
 
     private_handle_t *prev_handle = (private_handle_t *)(cur_layer->handle);
+    hwc_rect_t *frame = &cur_layer->displayFrame;
     hwc_rect_t *cur_rect = (hwc_rect_t *)cur_layer->visibleRegionScreen.rects;
     uint8_t *dst_addr = (uint8_t *)win->vir_addr[win->buf_index];
     uint8_t *src_addr = (uint8_t *)prev_handle->base;
-    uint32_t cpy_size = 0;
+    size_t bpp = prev_handle->uiBpp / 8;
+    size_t src_pitch = prev_handle->iStride * bpp;
+    size_t dst_pitch = window_line_length(win);
+    int win_x = win->rect_info.x;
+    int win_y = win->rect_info.y;
+    int win_right = win_x + win->rect_info.w;
+    int win_bottom = win_y + win->rect_info.h;
+
+    /* a fresh buffer for a partly covered layer: whatever no rect covers
+     * stays transparent, for the framebuffer underneath to show through */
+    if (win->set_win_flag == 1 && cur_layer->visibleRegionScreen.numRects > 1) {
+        for (uint32_t y = 0; y < win->rect_info.h; y++)
+            memset(&dst_addr[y * dst_pitch], 0, win->rect_info.w * bpp);
+    }
 
-    if(MAX_NUM_OF_WIN <= win_idx)
+    for (unsigned int i = 0; i < cur_layer->visibleRegionScreen.numRects; i++, cur_rect++) {
+        int left = SAM_MAX(SAM_MAX(cur_rect->left, frame->left), win_x);
+        int top = SAM_MAX(SAM_MAX(cur_rect->top, frame->top), win_y);
+        int right = SAM_MIN(SAM_MIN(cur_rect->right, frame->right), win_right);
+        int bottom = SAM_MIN(SAM_MIN(cur_rect->bottom, frame->bottom), win_bottom);
+
+        if (left >= right || top >= bottom)
+            continue;
+
+        uint8_t *cur_src_addr = &src_addr[(top - frame->top + cur_layer->sourceCrop.top) * src_pitch +
+                                          (left - frame->left + cur_layer->sourceCrop.left) * bpp];
+        uint8_t *cur_dst_addr = &dst_addr[(top - win_y) * dst_pitch + (left - win_x) * bpp];
+
+        sam_blit_rows(cur_dst_addr, dst_pitch, cur_src_addr, src_pitch,
+                      (right - left) * bpp, bottom - top);
+    }
+
+    return 0;
+}
+
+/*
+ * A layer gralloc allocated out of this window's memory is scanned out
+ * where it is, as long as the window shows all of it from its first pixel:
+ * no crop, no transform, not clipped or covered. Returns the line of the window's
+ * memory it starts at, or -1 to copy it.
+ */
+static int overlay_buffer_yoffset(hwc_layer_t *cur_layer,
+                                  struct hwc_win_info_t *win)
+{
+    private_handle_t *prev_handle = (private_handle_t *)(cur_layer->handle);
+    hwc_rect_t *frame = &cur_layer->displayFrame;
+    uint32_t phys = prev_handle->uiPhys;
+    uint32_t offset;
+
+    if (!(prev_handle->flags & private_handle_t::PRIV_FLAGS_OVERLAY) ||
+            cur_layer->visibleRegionScreen.numRects != 1 ||
+            phys < win->fix_info.smem_start ||
+            phys >= win->fix_info.smem_start + win->fix_info.smem_len)
         return -1;
 
-    for (unsigned int i = 0; i < cur_layer->visibleRegionScreen.numRects; i++) {
-        int w = cur_rect->right - cur_rect->left;
-        int h = cur_rect->bottom - cur_rect->top;
-        uint8_t *cur_dst_addr = dst_addr;
-        uint8_t *cur_src_addr = &src_addr[((cur_rect->top - cur_layer->displayFrame.top) *
-                                           (cur_layer->displayFrame.right - cur_layer->displayFrame.left) +
-                                           (cur_rect->left - cur_layer->displayFrame.left)) * (prev_handle->uiBpp / 8)];
-
-        if (w == (cur_layer->displayFrame.right - cur_layer->displayFrame.left)) {
-            cpy_size= w * (prev_handle->uiBpp / 8) * h;
-            h = 1;
-        } else {
-            cpy_size= w * (prev_handle->uiBpp / 8);
+    offset = phys - win->fix_info.smem_start;
+    if ((offset % win->fix_info.line_length) ||
+            prev_handle->iStride * (prev_handle->uiBpp / 8) != (int)win->fix_info.line_length)
+        return -1;
+
+    if (cur_layer->transform || cur_layer->sourceCrop.left || cur_layer->sourceCrop.top ||
+            (int)win->rect_info.x != frame->left || (int)win->rect_info.y != frame->top ||
+            (int)win->rect_info.w != frame->right - frame->left ||
+            (int)win->rect_info.h != frame->bottom - frame->top)
+        return -1;
+
+    return offset / win->fix_info.line_length;
+}
+
+/*
+ * Sets the scanout() word of a pool buffer about to be queued to the HEO,
+ * so its producer's gralloc_lock waits until we take it back. The word is
+ * set and cleared through a page of the buffer mapped here, which stays
+ * valid even if the buffer is freed meanwhile. NULL if it can't be held.
+ */
+static volatile int32_t *heo_hold_buffer(private_handle_t *handle)
+{
+    off_t word = handle->offset + handle->size - sizeof(int32_t);
+    off_t page = word & ~(PAGE_SIZE - 1);
+    void *addr;
+
+    if (!(handle->flags & private_handle_t::PRIV_FLAGS_SCANOUT))
+        return NULL;
+    addr = mmap(0, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                handle->fd, page);
+    if (addr == MAP_FAILED) {
+        LOGE("%s: can't map %s", __func__, strerror(errno));
+        return NULL;
+    }
+
+    volatile int32_t *hold = (volatile int32_t *)((uint8_t *)addr + (word - page));
+    android_atomic_release_store(1, hold);
+    return hold;
+}
+
+/* lets the producer write into the buffer again */
+static void heo_unhold_buffer(volatile int32_t *hold)
+{
+    android_atomic_release_store(0, hold);
+    munmap((void *)((uint32_t)hold & ~(PAGE_SIZE - 1)), PAGE_SIZE);
+}
+
+/* the buffer queued at index, taken back from the driver */
+static void heo_drop_hold(struct hwc_win_info_t_heo *win, int index)
+{
+    if (win->buf_hold[index])
+        heo_unhold_buffer(win->buf_hold[index]);
+    win->buf_hold[index] = NULL;
+    win->buf_handle[index] = 0;
+}
+
+/* every queued buffer comes back, see v4l2_overlay_stream_off */
+static int heo_stream_off(struct hwc_win_info_t_heo *win)
+{
+    int ret = v4l2_overlay_stream_off(win);
+
+    if (!ret) {
+        for (int i = 0; i < MAX_NUM_OF_HEO_BUF; i++)
+            heo_drop_hold(win, i);
+    }
+    return ret;
+}
+
+/*
+ * Takes back the buffers the LCDC is done with until keep are left
+ * queued, waiting up to timeout ms for each. Called with queue_lock held.
+ */
+static void heo_reap_buffers(struct hwc_win_info_t_heo *win, uint32_t keep,
+                             int timeout)
+{
+    int index;
+
+    while (win->qd_buf_count > keep && v4l2_overlay_poll(win->fd, timeout) > 0) {
+        if (v4l2_overlay_dq_buf(win->fd, &index, win->zero_copy) < 0)
+            break;
+        if ((uint32_t)index < win->num_of_buffer &&
+                win->buf_state[index] == HEO_BUF_QUEUED) {
+            win->buf_state[index] = HEO_BUF_FREE;
+            win->qd_buf_count--;
+            heo_drop_hold(win, index);
+        }
+    }
+}
+
+/*
+ * Takes direct buffers back as soon as the LCDC is done with them, not at
+ * the next hwc_set: their producer waits for that in gralloc_lock, and the
+ * next hwc_set may well be waiting on that producer's next frame.
+ */
+static void *heo_release_loop(void *data)
+{
+    struct hwc_win_info_t_heo *win = (struct hwc_win_info_t_heo *)data;
+    int ready;
+
+    pthread_mutex_lock(&win->queue_lock);
+    for (;;) {
+        while (!(win->zero_copy && win->qd_buf_count > 1) && !win->release_exit)
+            pthread_cond_wait(&win->queue_cond, &win->queue_lock);
+        if (win->release_exit)
+            break;
+
+        /* the next vsync, without holding up copy_heo_src_content */
+        pthread_mutex_unlock(&win->queue_lock);
+        ready = v4l2_overlay_poll(win->fd, HEO_RELEASE_POLL_MS);
+        pthread_mutex_lock(&win->queue_lock);
+        if (ready > 0) {
+            heo_reap_buffers(win, 1, 0);
+        } else if (!win->release_exit) {
+            /* stream going off, or stalled: nothing to spin on */
+            pthread_mutex_unlock(&win->queue_lock);
+            usleep(HEO_RELEASE_POLL_MS * 1000);
+            pthread_mutex_lock(&win->queue_lock);
+        }
+    }
+    pthread_mutex_unlock(&win->queue_lock);
+    return NULL;
+}
+
+/*
+ * A buffer to fill for the HEO, after taking back every one the LCDC is
+ * done with, without waiting for any. -1 while they are all queued.
+ */
+static int heo_free_buffer(struct hwc_win_info_t_heo *win)
+{
+    int index;
+
+    heo_reap_buffers(win, 0, 0);
+
+    /* in turn after the last one queued */
+    for (uint32_t i = 1; i <= win->num_of_buffer; i++) {
+        index = (win->buf_index + i) % win->num_of_buffer;
+        if (win->buf_state[index] == HEO_BUF_FREE)
+            return index;
+    }
+    return -1;
+}
+
+/*
+ * Whether the HEO can fetch the layer's buffer as it is: a YUYV frame out
+ * of the gralloc overlay pool, so physically contiguous, shown whole. The
+ * camera preview asks for those; they are queued by user pointer instead
+ * of copied into our buffers. Checked again for each buffer queued, the
+ * pool may run out for some of a layer's buffers.
+ */
+static int heo_layer_direct(struct hwc_win_info_t_heo *win, hwc_layer_t *cur)
+{
+    private_handle_t *handle = (private_handle_t *)cur->handle;
+
+    return win->direct_ok &&
+           (handle->flags & private_handle_t::PRIV_FLAGS_SCANOUT) &&
+           handle->iFormat == HAL_PIXEL_FORMAT_YCbCr_422_I &&
+           !cur->transform && !cur->sourceCrop.left && !cur->sourceCrop.top &&
+           cur->sourceCrop.right == handle->iStride;
+}
+
+/*
+ * New buffers for the layer size and format the window was last given:
+ * the layer's own ones when direct, else mapped ones to copy into. Falls
+ * back to the latter for good if the driver takes no user pointers.
+ */
+static int heo_setup_buffers(struct hwc_win_info_t_heo *win, int direct)
+{
+    int ret;
+
+    ret = heo_stream_off(win);
+    if (ret) {
+        LOGE("%s: steam off error", __func__);
+        return ret;
+    }
+
+    if (!win->zero_copy) {
+        for (unsigned int i = 0; i < win->num_of_buffer; i++) {
+            v4l2_overlay_unmap_buf(win->buffers[i], win->buffers_len[i]);
         }
+    }
+    win->num_of_buffer = 0;
+    win->buf_format = 0;
+
+    ret = v4l2_overlay_init(win);
+    if (ret) {
+        LOGE("%s: Error initializing heo overlay", __func__);
+        return ret;
+    }
+
+    /* the layer's lines as they are, or nothing */
+    if (direct && win->pitch != win->video_width * 2)
+        direct = 0;
+    win->zero_copy = direct;
+
+    ret = v4l2_overlay_set_position(win);
+    if ( ret < 0) {
+        LOGE("%s::v4l2_overlay_set_position is failed : %s",
+             __func__, strerror(errno));
+    }
+    win->set_win_flag = 0;
+
+    if (win->buffers)
+        delete [] win->buffers;
+    if (win->buffers_len)
+        delete [] win->buffers_len;
+    win->buffers = NULL;
+    win->buffers_len = NULL;
 
-        for (int j = 0; j < h ; j++) {
-            memcpy(cur_dst_addr, cur_src_addr, cpy_size);
-            //cur_dst_addr = &cur_dst_addr[win->fix_info.line_length];
-            cur_dst_addr = &cur_dst_addr[cpy_size];
-            cur_src_addr = &cur_src_addr[(cur_layer->displayFrame.right - cur_layer->displayFrame.left) * (prev_handle->uiBpp / 8)];
+    /* layer buffers stay held while queued, see heo_hold_buffer */
+    win->num_of_buffer = win->zero_copy ? NUM_OF_HEO_DIRECT_BUF : win->req_buffers;
+
+    ret = v4l2_overlay_req_buf(win);
+    if (ret && win->zero_copy) {
+        LOGW("%s: no user pointers on the HEO, copying", __func__);
+        win->direct_ok = 0;
+        win->zero_copy = 0;
+        win->num_of_buffer = win->req_buffers;
+        ret = v4l2_overlay_req_buf(win);
+    }
+    if (ret) {
+        LOGE("%s: Failed requesting buffers", __func__);
+        return ret;
+    }
+    memset(win->buf_state, HEO_BUF_FREE, sizeof(win->buf_state));
+    win->qd_buf_count = 0;
+    win->buf_index = win->num_of_buffer - 1;
+
+    win->buffers = new void* [win->num_of_buffer];
+    win->buffers_len = new size_t [win->num_of_buffer];
+
+    if (!win->buffers || !win->buffers_len) {
+        LOGE("%s: Failed alloc'ing buffer arrays", __func__);
+        return -ENOMEM;
+    }
+
+    if (!win->zero_copy) {
+        for (unsigned int j = 0; j < win->num_of_buffer; j++) {
+            ret = v4l2_overlay_map_buf(win->fd, j, &win->buffers[j], &win->buffers_len[j]);
+            if (ret) {
+                LOGE("%s: Failed mapping buffers", __func__);
+                return ret;
+            }
+            LOGD("%s:: mapping success, fd:%d, num:%d, buffers:%p, buffers_len:%d",
+                 __func__, win->fd, j, win->buffers[j], win->buffers_len[j]);
         }
+    }
 
-        cur_rect++;
+    ret = v4l2_overlay_stream_on(win);
+    if (ret) {
+        LOGE("%s: steam on error", __func__);
+        return ret;
     }
 
+    win->buf_format = win->layer_prev_format;
+    win->buf_width = win->video_width;
+    win->buf_height = win->video_height;
     return 0;
 }
 
@@ -117,7 +434,7 @@ static int copy_heo_src_content(hwc_layer_t *cur_layer,
 {
     private_handle_t *prev_handle = (private_handle_t *)(cur_layer->handle);
     hwc_rect_t *cur_rect = (hwc_rect_t *)cur_layer->visibleRegionScreen.rects;
-    uint8_t *dst_addr = (uint8_t *)win->buffers[win->buf_index];
+    uint8_t *dst_addr;
     uint8_t *src_addr = (uint8_t *)prev_handle->base;
     uint32_t cpy_size = 0;
     uint32_t BPP = 0;
@@ -138,41 +455,95 @@ static int copy_heo_src_content(hwc_layer_t *cur_layer,
         cpy_size = w * prev_handle->uiBpp / 8 * h;
         h = 1;
         break;
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+    case HAL_PIXEL_FORMAT_RGB_565:
+        BPP = prev_handle->uiBpp / 8;
+        break;
     default :
         LOGE("%s, heo don't support this format", __func__);
         return 0;
     }
 
-    for (unsigned int i = 0; i < cur_layer->visibleRegionScreen.numRects; i++) {
-        uint8_t *cur_dst_addr = dst_addr;
-        uint8_t *cur_src_addr = src_addr;
+    int index = heo_free_buffer(win);
+    if (index < 0) {
+        /* all still waiting for scan-out: skip this frame rather than
+         * wait, the next one takes the layer again */
+        win->layer_prev_buf = 0;
+        LOGV("%s:: %d buffers queued, frame skipped", __func__, win->qd_buf_count);
+        return 0;
+    }
+
+    if (win->zero_copy) {
+        volatile int32_t *hold = NULL;
 
-        for (int j = 0; j < h ; j++) {
-            memcpy(cur_dst_addr, cur_src_addr, cpy_size);
-            cur_dst_addr = &cur_dst_addr[cpy_size];
-            cur_src_addr = &cur_src_addr[(cur_layer->displayFrame.right - cur_layer->displayFrame.left) * (prev_handle->uiBpp / 8)];
+        /* still queued, and held since: the HEO has it already */
+        for (uint32_t i = 0; i < win->num_of_buffer; i++) {
+            if (win->buf_state[i] == HEO_BUF_QUEUED &&
+                    win->buf_handle[i] == (uint32_t)prev_handle)
+                return 0;
         }
-        cur_rect++;
-    }
 
-    if (v4l2_overlay_q_buf( win->fd, win->buf_index, win->zero_copy) < 0) {
-        LOGE("%s:Failed to Qbuf", __func__);
-        return -1;
-    } else {
-        win->qd_buf_count++;
-    }
+        if (heo_layer_direct(win, cur_layer))
+            hold = heo_hold_buffer(prev_handle);
+        if (hold && v4l2_overlay_q_buf(win->fd, index, (void *)prev_handle->base,
+                                       prev_handle->size) == 0) {
+            win->buf_index = index;
+            win->buf_state[index] = HEO_BUF_QUEUED;
+            win->qd_buf_count++;
+            win->buf_handle[index] = (uint32_t)prev_handle;
+            win->buf_hold[index] = hold;
+            /* for release_thread to take the one before back */
+            pthread_cond_signal(&win->queue_cond);
+            return 0;
+        }
 
-    if (win->qd_buf_count < win->num_of_buffer) {
-        win->buf_index = (win->buf_index + 1) % NUM_OF_HEO_BUF;
-        return 0;
+        if (hold) {
+            /* the buffer was refused: copy it, this frame and the next ones */
+            LOGW("%s: user pointer refused, copying", __func__);
+            heo_unhold_buffer(hold);
+            win->direct_ok = 0;
+        } else {
+            /* one the pool had no room for, or not held: copy this layer's
+             * buffers until it is placed again */
+            LOGW("%s: layer buffer not in place, copying", __func__);
+        }
+        if (heo_setup_buffers(win, 0) < 0)
+            return -1;
+        index = heo_free_buffer(win);
+        if (index < 0)
+            return -1;
+    }
+    win->buf_index = index;
+    dst_addr = (uint8_t *)win->buffers[index];
+
+    if (BPP) {
+        /* the crop of an RGB layer, line by line; the scaler does the rest */
+        size_t src_pitch = prev_handle->iStride * BPP;
+        size_t dst_pitch = win->pitch ? win->pitch : w * BPP;
+
+        src_addr += cur_layer->sourceCrop.top * src_pitch +
+                    cur_layer->sourceCrop.left * BPP;
+        if (win->swap_rb)
+            sam_blit_rows_swap_rb(dst_addr, dst_pitch, src_addr, src_pitch, w, h);
+        else
+            sam_blit_rows(dst_addr, dst_pitch, src_addr, src_pitch, w * BPP, h);
+    } else {
+        for (unsigned int i = 0; i < cur_layer->visibleRegionScreen.numRects; i++) {
+            sam_blit_rows(dst_addr, cpy_size, src_addr,
+                          (cur_layer->displayFrame.right - cur_layer->displayFrame.left) * (prev_handle->uiBpp / 8),
+                          cpy_size, h);
+            cur_rect++;
+        }
     }
 
-    if (v4l2_overlay_dq_buf( win->fd, &win->buf_index,win->zero_copy) < 0) {
+    if (v4l2_overlay_q_buf(win->fd, win->buf_index, NULL, 0) < 0) {
         LOGE("%s:Failed to Qbuf", __func__);
         return -1;
-    } else {
-        win->qd_buf_count--;
     }
+    win->buf_state[win->buf_index] = HEO_BUF_QUEUED;
+    win->qd_buf_count++;
 
     return 0;
 }
@@ -183,6 +554,9 @@ static void reset_win_rect_info(hwc_win_info_t *win)
     win->rect_info.y = 0;
     win->rect_info.w = 0;
     win->rect_info.h = 0;
+    win->zero_copy = 0;
+    win->layer_prev_buf = 0;
+    win->num_rects = 0;
     if (window_reset_pos(win) < 0) {
         LOGE("%s::window_set_pos is failed : %s",
              __func__, strerror(errno));
@@ -193,16 +567,22 @@ static void reset_win_rect_info(hwc_win_info_t *win)
 static void reset_heo_win_rect_info(hwc_win_info_t_heo *win)
 {
     int ret = 0;
-    ret = v4l2_overlay_stream_off(win);
+    pthread_mutex_lock(&win->queue_lock);
+    ret = heo_stream_off(win);
+    pthread_mutex_unlock(&win->queue_lock);
     if (ret) {
         LOGE("%s: steam off error", __func__);
     } else {
         win->set_win_flag = 1;
-        win->qd_buf_count = 0;
     }
+    win->layer_prev_buf = 0;
     return;
 }
 
+/*
+ * Whether the layer could go on a window at all, and on which: USE_OVR
+ * and USE_HEO in *usage. hwc_prepare leaves the choice to the planner.
+ */
 static int get_hwc_compos_decision(hwc_layer_t* cur, int *usage)
 {
     if (cur->flags & HWC_SKIP_LAYER || !cur->handle) {
@@ -228,30 +608,44 @@ static int get_hwc_compos_decision(hwc_layer_t* cur, int *usage)
                ((cur->displayFrame.bottom - cur->displayFrame.top) < 4))
         return compositionType;
 
-    if (cur->visibleRegionScreen.numRects != 1)
+    /* partly covered layers only on OVL windows, which have alpha for the
+     * covered parts; HEO has none and shows the whole frame */
+    if (cur->visibleRegionScreen.numRects < 1 ||
+            cur->visibleRegionScreen.numRects > MAX_NUM_OF_RECTS)
         return compositionType;
 
-    /* We only handle RGBA8888 data here */
+    bool scaled = (cur->sourceCrop.right - cur->sourceCrop.left) != (cur->displayFrame.right - cur->displayFrame.left) ||
+                  (cur->sourceCrop.bottom - cur->sourceCrop.top) != (cur->displayFrame.bottom - cur->displayFrame.top);
+
+    /* the HEO has no per-pixel alpha: RGB on it must not need any */
+    bool opaque = cur->blending == HWC_BLENDING_NONE ||
+                  prev_handle->iFormat == HAL_PIXEL_FORMAT_RGBX_8888 ||
+                  prev_handle->iFormat == HAL_PIXEL_FORMAT_RGB_565;
+
+    /* RGB as it is on OVL windows, any RGB and all YUV on HEO */
     switch (prev_handle->iFormat) {
     case HAL_PIXEL_FORMAT_RGBA_8888:
     case HAL_PIXEL_FORMAT_BGRA_8888:
     case HAL_PIXEL_FORMAT_RGBX_8888:
-        if (((cur->sourceCrop.right - cur->sourceCrop.left) != (cur->displayFrame.right - cur->displayFrame.left))
-                ||
-                ((cur->sourceCrop.bottom - cur->sourceCrop.top) != (cur->displayFrame.bottom - cur->displayFrame.top))) {
-            compositionType = HWC_FRAMEBUFFER;
-            LOGE("%s :: We need to scaler, didn't support now!", __func__);
-        } else {
+    case HAL_PIXEL_FORMAT_RGB_565:
+        /* the scaler takes the whole crop and has no rotation; layers
+         * that blend stay on OVL windows, or in GLES when scaled */
+        if (cur->visibleRegionScreen.numRects == 1 && !cur->transform && opaque &&
+                v4l2_overlay_format_supported(prev_handle->iFormat))
+            *usage |= USE_HEO;
+        if (!scaled && prev_handle->iFormat != HAL_PIXEL_FORMAT_RGB_565)
+            *usage |= USE_OVR;
+        if (*usage)
             compositionType = HWC_OVERLAY;
-            *usage = USE_OVR;
-            LOGV("%s::compositionType %d bpp %d format %x",
-                 __func__,compositionType, prev_handle->uiBpp, prev_handle->iFormat);
-        }
+        LOGV("%s::compositionType %d usage %x bpp %d format %x",
+             __func__,compositionType, *usage, prev_handle->uiBpp, prev_handle->iFormat);
         break;
     case HAL_PIXEL_FORMAT_YV12:
     case HAL_PIXEL_FORMAT_YCbCr_422_I:
+        if (cur->visibleRegionScreen.numRects != 1)
+            break;
         compositionType = HWC_OVERLAY;
-        *usage = USE_HEO;
+        *usage |= USE_HEO;
         LOGV("%s::compositionType %d bpp %d format %x",
              __func__,compositionType, prev_handle->uiBpp, prev_handle->iFormat);
         break;
@@ -265,6 +659,26 @@ static int get_hwc_compos_decision(hwc_layer_t* cur, int *usage)
     return  compositionType;
 }
 
+/* the bounding box of the layer's visible rects, as far as it is on screen */
+static void layer_window_rect(hwc_layer_t *cur, struct fb_var_screeninfo *lcd,
+                              sam_rect *rect)
+{
+    hwc_rect_t *visible_rect = (hwc_rect_t *)cur->visibleRegionScreen.rects;
+    hwc_rect_t bound = visible_rect[0];
+
+    for (unsigned int i = 1; i < cur->visibleRegionScreen.numRects; i++) {
+        bound.left = SAM_MIN(bound.left, visible_rect[i].left);
+        bound.top = SAM_MIN(bound.top, visible_rect[i].top);
+        bound.right = SAM_MAX(bound.right, visible_rect[i].right);
+        bound.bottom = SAM_MAX(bound.bottom, visible_rect[i].bottom);
+    }
+
+    rect->x = SAM_MAX(bound.left, 0);
+    rect->y = SAM_MAX(bound.top, 0);
+    rect->w = SAM_MIN(bound.right - rect->x, lcd->xres - rect->x);
+    rect->h = SAM_MIN(bound.bottom - rect->y, lcd->yres - rect->y);
+}
+
 static int assign_overlay_window(struct hwc_context_t *ctx,
                                  hwc_layer_t *cur,
                                  int win_idx,
@@ -278,19 +692,19 @@ static int assign_overlay_window(struct hwc_context_t *ctx,
         return -1;
 
     private_handle_t *prev_handle = (private_handle_t *)(cur->handle);
-    hwc_rect_t *visible_rect = (hwc_rect_t *)cur->visibleRegionScreen.rects;
+    int num_rects = cur->visibleRegionScreen.numRects;
     win = &ctx->win[win_idx];
 
     win->var_info.bits_per_pixel = prev_handle->uiBpp;
-    rect.x = SAM_MAX(visible_rect->left, 0);
-    rect.y = SAM_MAX(visible_rect->top, 0);
-    rect.w = SAM_MIN(visible_rect->right - rect.x, win->lcd_info.xres - rect.x);
-    rect.h = SAM_MIN(visible_rect->bottom - rect.y, win->lcd_info.yres - rect.y);
+    layer_window_rect(cur, &win->lcd_info, &rect);
     win->set_win_flag = 0;
 
+    /* covered parts move without the bounding box changing, clear them
+     * in a fresh buffer whenever the layer is or was partly covered */
     if ((rect.x != win->rect_info.x) || (rect.y != win->rect_info.y) ||
             (rect.w != win->rect_info.w) || (rect.h != win->rect_info.h) ||
-            (prev_handle->iFormat != win->layer_prev_format)) {
+            (prev_handle->iFormat != win->layer_prev_format) ||
+            num_rects > 1 || win->num_rects > 1) {
         win->rect_info.x = rect.x;
         win->rect_info.y = rect.y;
         win->rect_info.w = rect.w;
@@ -307,6 +721,7 @@ static int assign_overlay_window(struct hwc_context_t *ctx,
         }
     }
 
+    win->num_rects = num_rects;
     win->layer_index = layer_idx;
     win->status = HWC_WIN_RESERVED;
 
@@ -324,29 +739,33 @@ static int assign_heo_overlay_window(struct hwc_context_t *ctx,
 {
     struct hwc_win_info_t_heo *win;
     sam_rect rect;
+    int direct;
     int ret = 0;
 
     if (ctx->num_of_avail_heo <= win_idx)
         return -1;
 
     private_handle_t *prev_handle = (private_handle_t *)(cur->handle);
-    hwc_rect_t *visible_rect = (hwc_rect_t *)cur->visibleRegionScreen.rects;
     win = &ctx->win_heo[win_idx];
 
-    rect.x = SAM_MAX(visible_rect->left, 0);
-    rect.y = SAM_MAX(visible_rect->top, 0);
-    rect.w = SAM_MIN(visible_rect->right - rect.x, win->lcd_info.xres - rect.x);
-    rect.h = SAM_MIN(visible_rect->bottom - rect.y, win->lcd_info.yres - rect.y);
+    layer_window_rect(cur, &win->lcd_info, &rect);
 
+    /* where the scaler puts it, moved by hwc_set while streaming */
     if ((rect.x != win->rect_info.x) || (rect.y != win->rect_info.y) ||
-            (rect.w != win->rect_info.w) || (rect.h != win->rect_info.h) ||
-            (prev_handle->iFormat != win->layer_prev_format)) {
+            (rect.w != win->rect_info.w) || (rect.h != win->rect_info.h)) {
         win->rect_info.x = rect.x;
         win->rect_info.y = rect.y;
         win->rect_info.w = rect.w;
         win->rect_info.h = rect.h;
-        win->layer_prev_format = prev_handle->iFormat;
         win->set_win_flag = 1;
+    }
+
+    if (prev_handle->iFormat != (int32_t)win->layer_prev_format ||
+            (cur->sourceCrop.right - cur->sourceCrop.left) != (int)win->video_width ||
+            (cur->sourceCrop.bottom - cur->sourceCrop.top) != (int)win->video_height) {
+        win->layer_prev_format = prev_handle->iFormat;
+        win->video_width = (cur->sourceCrop.right - cur->sourceCrop.left);
+        win->video_height = (cur->sourceCrop.bottom - cur->sourceCrop.top);
         win->layer_prev_buf = 0;
         switch (prev_handle->iFormat) {
         case HAL_PIXEL_FORMAT_RGBA_8888:
@@ -357,103 +776,189 @@ static int assign_heo_overlay_window(struct hwc_context_t *ctx,
         }
     }
 
-    if ((cur->sourceCrop.right - cur->sourceCrop.left) != win->video_width ||
-            (cur->sourceCrop.bottom - cur->sourceCrop.top) != win->video_width) {
-        win->video_width = (cur->sourceCrop.right - cur->sourceCrop.left);
-        win->video_height = (cur->sourceCrop.bottom - cur->sourceCrop.top);
-    }
-
     win->layer_index = layer_idx;
     win->status = HWC_WIN_RESERVED;
 
-    if (!win->set_win_flag)
+    direct = heo_layer_direct(win, cur);
+
+    /* the buffers are still right for this size and format: at most the
+     * stream, off since the window was last released, starts again */
+    pthread_mutex_lock(&win->queue_lock);
+    if (win->buf_format == win->layer_prev_format &&
+            win->buf_width == win->video_width &&
+            win->buf_height == win->video_height &&
+            win->zero_copy == (bool)direct) {
+        ret = v4l2_overlay_stream_on(win);
+        pthread_mutex_unlock(&win->queue_lock);
+        if (ret) {
+            LOGE("%s: steam on error", __func__);
+            goto end;
+        }
         return 0;
+    }
 
-    ret = v4l2_overlay_stream_off(win);
-    if (ret) {
-        LOGE("%s: steam off error", __func__);
+    ret = heo_setup_buffers(win, direct);
+    pthread_mutex_unlock(&win->queue_lock);
+    if (ret)
         goto end;
-    } else {
-        win->qd_buf_count = 0;
-    }
 
-    if (!win->zero_copy) {
-        for (unsigned int i = 0; i < win->num_of_buffer; i++) {
-            v4l2_overlay_unmap_buf(win->buffers[i], win->buffers_len[i]);
-        }
-    }
+    LOGD("%s:: win_x %d win_y %d win_w %d win_h %d lay_idx %d win_idx %d iFormat %d",
+         __func__, win->rect_info.x, win->rect_info.y, win->rect_info.w,
+         win->rect_info.h, win->layer_index, win_idx, prev_handle->iFormat );
 
-    ret = v4l2_overlay_init(win);
-    if (ret) {
-        LOGE("%s: Error initializing heo overlay", __func__);
-        goto end;
-    }
+    return 0;
 
-    if (win->set_win_flag == 1) {
-        ret = v4l2_overlay_set_position(win);
-        if ( ret < 0) {
-            LOGE("%s::v4l2_overlay_set_position is failed : %s",
-                 __func__, strerror(errno));
-        }
-        win->set_win_flag = 0;
-    }
+end:
+    LOGE("%s: ret is %d", __func__, ret);
+    return ret;
+}
 
-    if (win->buffers)
-        delete [] win->buffers;
-    if (win->buffers_len)
-        delete [] win->buffers_len;
+/*****************************************************************************/
+/* which layers go on which windows, see SamHWCplan.h */
 
-    win->num_of_buffer = NUM_OF_HEO_BUF;
+static inline uint32_t plan_hash(uint32_t h, uint32_t v)
+{
+    return (h ^ v) * 16777619;      /* FNV-1a, a word at a time */
+}
 
-    ret = v4l2_overlay_req_buf(win);
-    if (ret) {
-        LOGE("%s: Failed requesting buffers", __func__);
-        goto end;
+static uint32_t plan_hash_rect(uint32_t h, const hwc_rect_t *r)
+{
+    h = plan_hash(h, r->left);
+    h = plan_hash(h, r->top);
+    h = plan_hash(h, r->right);
+    return plan_hash(h, r->bottom);
+}
+
+/* everything the plan depends on but the buffers themselves */
+static uint32_t plan_signature(struct hwc_context_t *ctx, hwc_layer_list_t *list)
+{
+    uint32_t h = 2166136261u;
+
+    h = plan_hash(h, list->numHwLayers);
+    h = plan_hash(h, ctx->num_of_avail_ovl << 8 | ctx->num_of_avail_heo);
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_t *cur = &list->hwLayers[i];
+        private_handle_t *handle = (private_handle_t *)cur->handle;
+
+        h = plan_hash(h, cur->flags & HWC_SKIP_LAYER);
+        h = plan_hash(h, handle ? handle->iFormat : -1);
+        h = plan_hash(h, handle ? handle->flags & private_handle_t::PRIV_FLAGS_OVERLAY : 0);
+        h = plan_hash(h, cur->transform);
+        h = plan_hash(h, cur->blending);
+        h = plan_hash_rect(h, &cur->sourceCrop);
+        h = plan_hash_rect(h, &cur->displayFrame);
+        h = plan_hash(h, cur->visibleRegionScreen.numRects);
+        for (size_t j = 0; j < cur->visibleRegionScreen.numRects; j++)
+            h = plan_hash_rect(h, &cur->visibleRegionScreen.rects[j]);
     }
+    return h;
+}
 
-    win->buffers = new void* [win->num_of_buffer];
-    win->buffers_len = new size_t [win->num_of_buffer];
+/*
+ * Bytes moved per frame for the layer each way it can go. GLES is software
+ * here, plan_gles_weight (hwc.plan.gles) times a memcpy per byte; the
+ * windows cost the CPU copy into them plus the LCDC scanning them out.
+ * Reconfiguring a window costs about a frame, so a window stays on the
+ * layer it already shows unless another saves clearly more.
+ */
+static void plan_layer_cost(struct hwc_context_t *ctx, hwc_layer_t *cur,
+                            int usage, struct sam_plan_layer *pl)
+{
+    memset(pl, 0, sizeof(*pl));
+    if (!usage)
+        return;
 
-    if (!win->buffers || !win->buffers_len) {
-        LOGE("%s: Failed alloc'ing buffer arrays", __func__);
-        ret = -ENOMEM;
-        goto end;
-    }
+    private_handle_t *handle = (private_handle_t *)cur->handle;
+    hwc_rect_t *visible_rect = (hwc_rect_t *)cur->visibleRegionScreen.rects;
+    /* YV12 is 12 bits a pixel, whatever uiBpp says */
+    uint32_t bits = handle->iFormat == HAL_PIXEL_FORMAT_YV12 ? 12 : handle->uiBpp;
+    uint32_t fb_bytes = ctx->lcd_info.bits_per_pixel / 8;
+    uint32_t frame = ctx->lcd_info.xres * ctx->lcd_info.yres * fb_bytes;
+    uint32_t crop_w = cur->sourceCrop.right - cur->sourceCrop.left;
+    uint32_t crop_h = cur->sourceCrop.bottom - cur->sourceCrop.top;
+    uint32_t src = crop_w * crop_h * bits / 8;
+    uint32_t visible = 0;
+    sam_rect rect;
 
-    if (!win->zero_copy) {
-        for (unsigned int j = 0; j < win->num_of_buffer; j++) {
-            ret = v4l2_overlay_map_buf(win->fd, j, &win->buffers[j], &win->buffers_len[j]);
-            if (ret) {
-                LOGE("%s: Failed mapping buffers", __func__);
-                goto end;
-            }
-            LOGD("%s:: mapping success, fd:%d, num:%d, buffers:%p, buffers_len:%d",
-                 __func__, win->fd, j, win->buffers[j], win->buffers_len[j]);
+    for (unsigned int i = 0; i < cur->visibleRegionScreen.numRects; i++)
+        visible += (visible_rect[i].right - visible_rect[i].left) *
+                   (visible_rect[i].bottom - visible_rect[i].top);
+
+    /* the crop read, the screen written, and read first to blend */
+    pl->gles = ctx->plan_gles_weight *
+               (src + visible * fb_bytes * (cur->blending == HWC_BLENDING_NONE ? 1 : 2));
+
+    if (usage & USE_OVR) {
+        layer_window_rect(cur, &ctx->lcd_info, &rect);
+        for (unsigned int w = 0; w < ctx->num_of_avail_ovl && w < SAM_PLAN_MAX_OVR; w++) {
+            struct hwc_win_info_t *win = &ctx->win[w];
+
+            pl->ovr[w] = rect.w * rect.h * bits / 8;
+            /* no copy for a buffer out of this window's memory */
+            if (win->no_vsync ||
+                    !(handle->flags & private_handle_t::PRIV_FLAGS_OVERLAY) ||
+                    cur->visibleRegionScreen.numRects != 1 ||
+                    (uint32_t)handle->uiPhys < win->fix_info.smem_start ||
+                    (uint32_t)handle->uiPhys >= win->fix_info.smem_start + win->fix_info.smem_len)
+                pl->ovr[w] += 2 * visible * bits / 8;
+            if (memcmp(&rect, &win->rect_info, sizeof(rect)) ||
+                    (uint32_t)handle->iFormat != win->layer_prev_format)
+                pl->ovr_reconfig[w] = frame;
         }
+        pl->can |= SAM_PLAN_OVR;
     }
 
-    ret = v4l2_overlay_stream_on(win);
-    if (ret) {
-        LOGE("%s: steam on error", __func__);
-        goto end;
+    if (usage & USE_HEO) {
+        struct hwc_win_info_t_heo *win = &ctx->win_heo[0];
+        int direct = heo_layer_direct(win, cur);
+
+        /* copied in, then fetched by the scaler; only fetched in place */
+        pl->heo = direct ? src : 3 * src;
+        /* moving it is next to free, new buffers are not: streaming
+         * restarts on buffers mapped and filled anew */
+        if ((uint32_t)handle->iFormat != win->buf_format ||
+                crop_w != win->buf_width || crop_h != win->buf_height ||
+                win->zero_copy != (bool)direct)
+            pl->heo_reconfig = frame + win->req_buffers * src;
+        pl->can |= SAM_PLAN_HEO;
     }
+}
 
-    LOGD("%s:: win_x %d win_y %d win_w %d win_h %d lay_idx %d win_idx %d iFormat %d",
-         __func__, win->rect_info.x, win->rect_info.y, win->rect_info.w,
-         win->rect_info.h, win->layer_index, win_idx, prev_handle->iFormat );
+/*
+ * Where each layer goes, topmost first, into ctx->plan_target. Worked out
+ * again only when the signature of the list changes.
+ */
+static void plan_layers(struct hwc_context_t *ctx, hwc_layer_list_t *list)
+{
+    struct sam_plan_layer layers[SAM_PLAN_MAX_LAYERS];
+    int count = SAM_MIN(list->numHwLayers, SAM_PLAN_MAX_LAYERS);
+    uint32_t signature = plan_signature(ctx, list);
+    int placed;
 
-    return 0;
+    if (ctx->plan_valid && ctx->plan_signature == signature)
+        return;
 
-end:
-    LOGE("%s: ret is %d", __func__, ret);
-    return ret;
+    for (int p = 0; p < count; p++) {
+        hwc_layer_t *cur = &list->hwLayers[list->numHwLayers - 1 - p];
+        int usage = 0;
+
+        if (get_hwc_compos_decision(cur, &usage) == HWC_FRAMEBUFFER)
+            usage = 0;
+        plan_layer_cost(ctx, cur, usage, &layers[p]);
+    }
+
+    placed = sam_plan_layers(layers, count, ctx->num_of_avail_ovl,
+                             ctx->num_of_avail_heo, ctx->plan_target);
+    ctx->plan_signature = signature;
+    ctx->plan_valid = 1;
+    LOGV("%s:: %d of %d layers on windows", __func__, placed, list->numHwLayers);
 }
 
 static int hwc_prepare(hwc_composer_device_t *dev, hwc_layer_list_t* list) {
     struct hwc_context_t* ctx = (struct hwc_context_t*)dev;
     int overlay_win_cnt = ctx->num_of_avail_ovl;
     int overlay_win_heo_cnt = ctx->num_of_avail_heo;
-    int compositionType = 0;
+    int planned;
     int ret;
 
     //if geometry is not changed, there is no need to do any work here
@@ -475,47 +980,43 @@ static int hwc_prepare(hwc_composer_device_t *dev, hwc_layer_list_t* list) {
 
     LOGV("%s:: hwc_prepare list->numHwLayers %d", __func__, list->numHwLayers);
 
+    planned = (overlay_win_cnt + overlay_win_heo_cnt) > 0 &&
+              (list->numHwLayers > 1 || ctx->num_of_hwc_layer_prev > 0);
+    if (planned)
+        plan_layers(ctx, list);
+
     for (int i = list->numHwLayers -1 ; i >= 0 ; i--) {
-        int usage =0;
         hwc_layer_t* cur = &list->hwLayers[i];
-
-        if ((overlay_win_cnt + overlay_win_heo_cnt) > 0 && 
-			(list->numHwLayers > 1 || ctx->num_of_hwc_layer_prev > 0)) {
-            compositionType = get_hwc_compos_decision(cur, &usage);
-
-            if (compositionType == HWC_FRAMEBUFFER) {
-                cur->compositionType = HWC_FRAMEBUFFER;
-                ctx->num_of_fb_layer++;
-            } else {
-                if (usage == USE_OVR) {
-                    ret = assign_overlay_window(ctx, cur, overlay_win_cnt -1, i);
-                    if (ret != 0) {
-                        cur->compositionType = HWC_FRAMEBUFFER;
-                        ctx->num_of_fb_layer++;
-                        continue;
-                    }
-                    overlay_win_cnt--;
-                } else if (usage == USE_HEO) {
-                    ret = assign_heo_overlay_window(ctx, cur, overlay_win_heo_cnt -1, i);
-                    if (ret != 0) {
-                        cur->compositionType = HWC_FRAMEBUFFER;
-                        ctx->num_of_fb_layer++;
-                        continue;
-                    }
-                    overlay_win_heo_cnt--;
-                } else {
-                    LOGE("%s: unknow usage type %d", __func__, usage);
-                    continue;
-                }
-
-                cur->compositionType = HWC_OVERLAY;
-                cur->hints = HWC_HINT_CLEAR_FB;
-                ctx->num_of_hwc_layer++;
-            }
+        int p = list->numHwLayers - 1 - i;
+        int target = SAM_PLAN_FB;
+
+        if (planned && p < SAM_PLAN_MAX_LAYERS)
+            target = ctx->plan_target[p];
+
+        if (target == SAM_PLAN_OVR) {
+            ret = assign_overlay_window(ctx, cur, overlay_win_cnt -1, i);
+            if (ret == 0)
+                overlay_win_cnt--;
+        } else if (target == SAM_PLAN_HEO) {
+            ret = assign_heo_overlay_window(ctx, cur, overlay_win_heo_cnt -1, i);
+            if (ret == 0)
+                overlay_win_heo_cnt--;
         } else {
+            ret = -1;
+        }
+
+        if (ret != 0) {
+            /* planned for a window that would not take it, plan anew */
+            if (target != SAM_PLAN_FB)
+                ctx->plan_valid = 0;
             cur->compositionType = HWC_FRAMEBUFFER;
             ctx->num_of_fb_layer++;
+            continue;
         }
+
+        cur->compositionType = HWC_OVERLAY;
+        cur->hints = HWC_HINT_CLEAR_FB;
+        ctx->num_of_hwc_layer++;
     }
 
     if(list->numHwLayers != (ctx->num_of_fb_layer + ctx->num_of_hwc_layer))
@@ -539,6 +1040,106 @@ static int hwc_prepare(hwc_composer_device_t *dev, hwc_layer_list_t* list) {
     return 0;
 }
 
+/*****************************************************************************/
+/* overlay copies off the composition thread */
+
+/* the copies hwc_set asked for, marking the ones that failed */
+static void run_copies(struct hwc_context_t *ctx, hwc_layer_list_t *list)
+{
+    int ret;
+
+    for (unsigned int i = 0; i < ctx->num_of_avail_ovl; i++) {
+        struct hwc_win_info_t *win = &ctx->win[i];
+
+        if (win->pending_copy != 1)
+            continue;
+        if (copy_src_content(&list->hwLayers[win->layer_index], win, i) < 0) {
+            win->layer_prev_buf = 0;
+            win->pending_copy = -1;
+            LOGE("%s:: win-id: %d, failed to copy data to overlay frame buffer", __func__, i);
+        } else {
+            win->pending_copy = 0;
+        }
+    }
+
+    for (unsigned int i = 0; i < ctx->num_of_avail_heo; i++) {
+        struct hwc_win_info_t_heo *win_heo = &ctx->win_heo[i];
+
+        if (win_heo->pending_copy != 1)
+            continue;
+        pthread_mutex_lock(&win_heo->queue_lock);
+        ret = copy_heo_src_content(&list->hwLayers[win_heo->layer_index], win_heo, i);
+        pthread_mutex_unlock(&win_heo->queue_lock);
+        if (ret < 0) {
+            win_heo->layer_prev_buf = 0;
+            win_heo->pending_copy = -1;
+            LOGE("%s:: heo-id: %d, failed to copy data to overlay frame buffer", __func__, i);
+        } else {
+            win_heo->pending_copy = 0;
+        }
+    }
+}
+
+static void *copy_thread_loop(void *data)
+{
+    struct hwc_context_t *ctx = (struct hwc_context_t *)data;
+
+    pthread_mutex_lock(&ctx->copy_lock);
+    for (;;) {
+        while (!ctx->copy_list && !ctx->copy_exit)
+            pthread_cond_wait(&ctx->copy_cond, &ctx->copy_lock);
+        if (ctx->copy_exit)
+            break;
+
+        hwc_layer_list_t *list = ctx->copy_list;
+        pthread_mutex_unlock(&ctx->copy_lock);
+        run_copies(ctx, list);
+        pthread_mutex_lock(&ctx->copy_lock);
+
+        ctx->copy_list = NULL;
+        pthread_cond_broadcast(&ctx->copy_cond);
+    }
+    pthread_mutex_unlock(&ctx->copy_lock);
+    return NULL;
+}
+
+/*
+ * Hands the frame's copies to copy_thread, or does them right away without
+ * one. The windows and the list are the thread's until wait_copies.
+ */
+static void start_copies(struct hwc_context_t *ctx, hwc_layer_list_t *list)
+{
+    bool any = false;
+
+    for (unsigned int i = 0; i < ctx->num_of_avail_ovl; i++)
+        any |= ctx->win[i].pending_copy == 1;
+    for (unsigned int i = 0; i < ctx->num_of_avail_heo; i++)
+        any |= ctx->win_heo[i].pending_copy == 1;
+    if (!any)
+        return;
+
+    if (!ctx->copy_threaded) {
+        run_copies(ctx, list);
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->copy_lock);
+    ctx->copy_list = list;
+    pthread_cond_broadcast(&ctx->copy_cond);
+    pthread_mutex_unlock(&ctx->copy_lock);
+}
+
+static void wait_copies(struct hwc_context_t *ctx)
+{
+    if (!ctx->copy_threaded)
+        return;
+
+    pthread_mutex_lock(&ctx->copy_lock);
+    while (ctx->copy_list)
+        pthread_cond_wait(&ctx->copy_cond, &ctx->copy_lock);
+    pthread_mutex_unlock(&ctx->copy_lock);
+}
+
 static int hwc_set(hwc_composer_device_t *dev,
                    hwc_display_t dpy,
                    hwc_surface_t sur,
@@ -582,35 +1183,47 @@ static int hwc_set(hwc_composer_device_t *dev,
         return 0;
     }
 
-    /* copy the content of hardware layers here */
+    /* what each window needs this frame; the copies themselves go to
+     * copy_thread, to run while eglSwapBuffers composes the rest */
     for (unsigned int i = 0; i < ctx->num_of_avail_ovl; i++) {
         win = &ctx->win[i];
+        win->pending_copy = 0;
+        win->pending_pan = -1;
+        win->pending_flip = 0;
         if (win->status == HWC_WIN_RESERVED) {
             cur = &list->hwLayers[win->layer_index];
 
             if (cur->compositionType == HWC_OVERLAY) {
-                if(copy_src_content(cur, win,i) < 0) {
-                    LOGE("%s:: win-id: %d, failed to copy data to overlay frame buffer", __func__, i);
-                    continue;
+                int yoffset = win->no_vsync ? -1 : overlay_buffer_yoffset(cur, win);
+
+                if (yoffset >= 0) {
+                    /* no copy, point the window at the buffer */
+                    if (win->set_win_flag == 1) {
+                        win->var_info.yoffset = yoffset;
+                        win->pending_flip = win->zero_copy;
+                    } else if (win->var_info.yoffset != (uint32_t)yoffset) {
+                        win->pending_pan = yoffset;
+                        win->pending_flip = 1;
+                    }
+                    win->zero_copy = 1;
+                } else {
+                    if (win->zero_copy) {
+                        /* back to our own screens */
+                        win->zero_copy = 0;
+                        win->set_win_flag = 1;
+                        win->layer_prev_buf = 0;
+                        win->pending_flip = 1;
+                    }
+                    if (!layer_unchanged(cur, &win->layer_prev_buf, &win->layer_prev_gen) ||
+                            win->set_win_flag == 1)
+                        win->pending_copy = 1;
                 }
 
             } else {
                 LOGE("%s:: error : layer %d compositionType should have been \
                         HWC_OVERLAY", __func__, win->layer_index);
                 win->status = HWC_WIN_RELEASE;
-                continue;
-            }
-
-            if (win->set_win_flag == 1) {
-            /* set the window position with new conf..., don't allow failed */
-                if (window_set_pos(win) < 0) {
-                    LOGE("Emergency error (%s) ::window_set_pos is failed : %s", __func__,
-                                strerror(errno));
-                    continue;
-                }
-                win->set_win_flag = 0;
             }
-            
         } else {
             LOGV("%s:: OVR window %d status should have been HWC_WIN_RESERVED \
                      by now... ", __func__, i);
@@ -618,9 +1231,9 @@ static int hwc_set(hwc_composer_device_t *dev,
         }
     }
 
-    /* copy the content of heo layers here */
     for (unsigned int i = 0; i < ctx->num_of_avail_heo; i++) {
         win_heo = &ctx->win_heo[i];
+        win_heo->pending_copy = 0;
         if (win_heo->status == HWC_WIN_RESERVED) {
             cur = &list->hwLayers[win_heo->layer_index];
             if (win_heo->set_win_flag == 1) {
@@ -633,15 +1246,13 @@ static int hwc_set(hwc_composer_device_t *dev,
             }
 
             if (cur->compositionType == HWC_OVERLAY) {
-                if(copy_heo_src_content(cur, win_heo,i) < 0) {
-                    LOGE("%s:: heo-id: %d, failed to copy data to overlay frame buffer", __func__, i);
-                    continue;
-                }
+                /* the last frame queued is still on screen */
+                if (!layer_unchanged(cur, &win_heo->layer_prev_buf, &win_heo->layer_prev_gen))
+                    win_heo->pending_copy = 1;
             } else {
                 LOGE("%s:: error : heo layer %d compositionType should have been \
-                        HWC_OVERLAY", __func__, win->layer_index);
-                win->status = HWC_WIN_RELEASE;
-                continue;
+                        HWC_OVERLAY", __func__, win_heo->layer_index);
+                win_heo->status = HWC_WIN_RELEASE;
             }
         } else {
             LOGV("%s:: HEO window %d status should have been HWC_WIN_RESERVED \
@@ -649,16 +1260,53 @@ static int hwc_set(hwc_composer_device_t *dev,
         }
     }
 
+    start_copies(ctx, list);
+
     /* compose the hardware layers here */
     // Base layer
     if (need_swap_buffers || !list) {
         EGLBoolean sucess = eglSwapBuffers((EGLDisplay)dpy, (EGLSurface)sur);
         if (!sucess) {
+            wait_copies(ctx);
             LOGE("%s: eglSwapBuffers failed", __func__);
             return HWC_EGL_ERROR;
         }
     }
 
+    wait_copies(ctx);
+
+    /* show the new contents */
+    struct hwc_win_info_t *flipped = NULL;
+    for (unsigned int i = 0; i < ctx->num_of_avail_ovl; i++) {
+        win = &ctx->win[i];
+        if (win->status != HWC_WIN_RESERVED || win->pending_copy < 0)
+            continue;
+
+        if (win->pending_pan >= 0 && window_pan_to(win, win->pending_pan) < 0)
+            continue;
+
+        if (win->set_win_flag == 1) {
+            /* set the window position with new conf..., don't allow failed */
+            if (window_set_pos(win) < 0) {
+                LOGE("Emergency error (%s) ::window_set_pos is failed : %s", __func__,
+                     strerror(errno));
+                continue;
+            }
+            win->set_win_flag = 0;
+        }
+        if (win->pending_flip)
+            flipped = win;
+    }
+
+    /* the layer buffer panned away from goes back to its producer once we
+     * return; the LCDC reads it until the next frame starts. One wait
+     * covers every window, they share the LCDC. */
+    if (flipped && window_wait_vsync(flipped) < 0) {
+        LOGW("%s:: no vsync to wait for, copying overlay layers", __func__);
+        for (unsigned int i = 0; i < ctx->num_of_avail_ovl; i++)
+            ctx->win[i].no_vsync = 1;
+    }
+
     for (unsigned int i = 0; i < ctx->num_of_avail_ovl; i++) {
         win = &ctx->win[i];
         if(win->status == HWC_WIN_RELEASE) {
@@ -685,6 +1333,16 @@ static int hwc_device_close(struct hw_device_t *dev)
     int i;
 
     if (ctx) {
+        if (ctx->copy_threaded) {
+            pthread_mutex_lock(&ctx->copy_lock);
+            ctx->copy_exit = 1;
+            pthread_cond_broadcast(&ctx->copy_cond);
+            pthread_mutex_unlock(&ctx->copy_lock);
+            pthread_join(ctx->copy_thread, NULL);
+        }
+        pthread_mutex_destroy(&ctx->copy_lock);
+        pthread_cond_destroy(&ctx->copy_cond);
+
         for (unsigned i = 0; i < ctx->num_of_avail_ovl; i++) {
             if (window_close(&ctx->win[i]) < 0) {
                 LOGE("%s::window_close() fail", __func__);
@@ -693,11 +1351,26 @@ static int hwc_device_close(struct hw_device_t *dev)
         }
 
         for (unsigned i=0; i < ctx->num_of_avail_heo; i++) {
-            if (v4l2_overlay_close(&ctx->win_heo[i]) < 0) {
+            struct hwc_win_info_t_heo *win_heo = &ctx->win_heo[i];
+
+            if (win_heo->release_threaded) {
+                pthread_mutex_lock(&win_heo->queue_lock);
+                win_heo->release_exit = 1;
+                pthread_cond_broadcast(&win_heo->queue_cond);
+                pthread_mutex_unlock(&win_heo->queue_lock);
+                pthread_join(win_heo->release_thread, NULL);
+            }
+            /* and let go of the layer buffers still queued */
+            heo_stream_off(win_heo);
+            if (v4l2_overlay_close(win_heo) < 0) {
                 LOGE("%s::v4l2_overlay_close() fail", __func__);
                 ret = -1;
             }
         }
+        for (int i = 0; i < MAX_NUM_OF_HEO; i++) {
+            pthread_mutex_destroy(&ctx->win_heo[i].queue_lock);
+            pthread_cond_destroy(&ctx->win_heo[i].queue_cond);
+        }
         free(ctx);
     }
     return 0;
@@ -723,6 +1396,12 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
 
     /* initialize our state here */
     memset(dev, 0, sizeof(*dev));
+    pthread_mutex_init(&dev->copy_lock, NULL);
+    pthread_cond_init(&dev->copy_cond, NULL);
+    for (int i = 0; i < MAX_NUM_OF_HEO; i++) {
+        pthread_mutex_init(&dev->win_heo[i].queue_lock, NULL);
+        pthread_cond_init(&dev->win_heo[i].queue_cond, NULL);
+    }
 
     /* initialize the procs */
     dev->device.common.tag = HARDWARE_DEVICE_TAG;
@@ -755,6 +1434,18 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
         dev->num_of_avail_ovl = NUM_OF_WIN;
     }
 
+    /* how overlay contents are copied, see SamHWCblit.h */
+    property_get("hwc.blit", value, "auto");
+    int engine = SAM_BLIT_AUTO;
+    for (int i = 0; i < SAM_BLIT_ENGINES; i++)
+        if (!strcmp(value, sam_blit_engine_name(i)))
+            engine = i;
+    LOGI("%s:: copying with %s", __func__, sam_blit_engine_name(sam_blit_select(engine)));
+
+    /* what a byte composed in GLES costs next to one copied, see plan_layer_cost */
+    property_get("hwc.plan.gles", value, "4");
+    dev->plan_gles_weight = SAM_MAX(atoi(value), 1);
+
     /* open Ovrlayer here */
     for (unsigned int i = 0; i < dev->num_of_avail_ovl; i++) {
         if (window_open(&(dev->win[i]), i) < 0) {
@@ -834,6 +1525,9 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
 
         win->size = win->fix_info.line_length * win->var_info.yres;
 
+        /* all of the memory, gralloc's overlay buffers live past our screens */
+        win->var_info.yres_virtual = win->fix_info.smem_len / win->fix_info.line_length;
+
         LOGD("line_length: %d, yres: %d, win->size is %d",win->fix_info.line_length, win->var_info.yres, win->size);
 
         if (!win->fix_info.smem_start) {
@@ -858,9 +1552,36 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
          
     }
 
+    /* buffers queued ahead of scan-out, more ride out longer GLES frames */
+    property_get("hwc.heo.buffers", value, "3");
+
     for (unsigned int i = 0; i < dev->num_of_avail_heo; i++) {
         win_heo = &dev->win_heo[i];
         memcpy(&win_heo->lcd_info, &dev->lcd_info, sizeof(struct fb_var_screeninfo));
+        win_heo->req_buffers = SAM_MIN(SAM_MAX(atoi(value), 2), MAX_NUM_OF_HEO_BUF);
+    }
+
+    /* pool buffers the HEO can fetch in place, unless hwc.heo.direct is 0 */
+    property_get("hwc.heo.direct", value, "1");
+    for (unsigned int i = 0; i < dev->num_of_avail_heo; i++) {
+        win_heo = &dev->win_heo[i];
+        win_heo->direct_ok = atoi(value) != 0;
+        if (win_heo->direct_ok) {
+            if (pthread_create(&win_heo->release_thread, NULL,
+                               heo_release_loop, win_heo) == 0)
+                win_heo->release_threaded = 1;
+            else
+                win_heo->direct_ok = 0;
+        }
+    }
+
+    /* overlay copies alongside eglSwapBuffers, unless hwc.copy_thread is 0 */
+    property_get("hwc.copy_thread", value, "1");
+    if (atoi(value)) {
+        if (pthread_create(&dev->copy_thread, NULL, copy_thread_loop, dev) == 0)
+            dev->copy_threaded = 1;
+        else
+            LOGE("%s:: no copy thread, copying inline", __func__);
     }
 
     LOGD("%s:: success\n", __func__);
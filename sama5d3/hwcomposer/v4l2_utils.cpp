@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <poll.h>
 #include <cutils/log.h>
 #include <linux/videodev.h>
 #include <sys/ioctl.h>
@@ -59,10 +60,8 @@ int v4l2_overlay_open(struct hwc_win_info_t_heo *win, const char *dir)
         goto error;
     }
 
-    /* Reserve: if the video buffer address could used by DMA
-      * Then, win->zero_copy = true;
-      * Then we can reduce on copy
-      */
+    /* mapped buffers until a layer the HEO can fetch in place, see
+     * heo_setup_buffers */
     win->zero_copy = false;
 
     LOGD("%s, open %s successful: fd:%d", __func__, name, win->fd);
@@ -201,26 +200,64 @@ static int v4l2_overlay_ioctl(int fd, int req, void *arg, const char* msg)
 /* 12  Y/CbCr 4:2:0 64x32 macroblocks */
 #define V4L2_PIX_FMT_NV12T       v4l2_fourcc('T', 'V', '1', '2')
 
+/* byte orders of the newer kernels, r g b a and so on in memory */
+#ifndef V4L2_PIX_FMT_RGBA32
+#define V4L2_PIX_FMT_RGBA32      v4l2_fourcc('A', 'B', '2', '4')
+#endif
+#ifndef V4L2_PIX_FMT_RGBX32
+#define V4L2_PIX_FMT_RGBX32      v4l2_fourcc('X', 'B', '2', '4')
+#endif
+#ifndef V4L2_PIX_FMT_ABGR32
+#define V4L2_PIX_FMT_ABGR32      v4l2_fourcc('A', 'R', '2', '4')
+#endif
+
+/*
+ * The V4L2 formats the HEO could take each layer format as, best first.
+ * Older drivers only know BGR32 for 32bpp, so RGBA layers also go as that
+ * with red and blue swapped during the copy.
+ */
+static const struct {
+    int32_t  hal;
+    uint32_t v4l2;
+    int      swap_rb;
+} heo_pixfmts[] = {
+    { HAL_PIXEL_FORMAT_YV12,          V4L2_PIX_FMT_NV12,   0 },
+    { HAL_PIXEL_FORMAT_YCbCr_422_I,   V4L2_PIX_FMT_YUYV,   0 },
+    { HAL_PIXEL_FORMAT_RGBA_8888,     V4L2_PIX_FMT_RGBA32, 0 },
+    { HAL_PIXEL_FORMAT_RGBA_8888,     V4L2_PIX_FMT_BGR32,  1 },
+    { HAL_PIXEL_FORMAT_RGBX_8888,     V4L2_PIX_FMT_RGBX32, 0 },
+    { HAL_PIXEL_FORMAT_RGBX_8888,     V4L2_PIX_FMT_BGR32,  1 },
+    { HAL_PIXEL_FORMAT_BGRA_8888,     V4L2_PIX_FMT_ABGR32, 0 },
+    { HAL_PIXEL_FORMAT_BGRA_8888,     V4L2_PIX_FMT_BGR32,  0 },
+    { HAL_PIXEL_FORMAT_RGB_565,       V4L2_PIX_FMT_RGB565, 0 },
+};
+
+/* the nth choice for fmt, -1 when there are no more */
 int configure_pixfmt(struct v4l2_pix_format *pix, int32_t fmt,
-                     uint32_t w, uint32_t h)
+                     uint32_t w, uint32_t h, int choice, int *swap_rb)
 {
     LOG_FUNCTION_NAME
-    int fd;
 
-    switch (fmt) {
-    case HAL_PIXEL_FORMAT_YV12:
-        pix->pixelformat = V4L2_PIX_FMT_NV12;
-        break;
-    case HAL_PIXEL_FORMAT_YCbCr_422_I:
-        pix->pixelformat = V4L2_PIX_FMT_YUYV;
-        break;
-    default:
-        LOGE("%s: unknow format %d", __func__, fmt);
-        return -1;
+    for (unsigned int i = 0; i < sizeof(heo_pixfmts) / sizeof(heo_pixfmts[0]); i++) {
+        if (heo_pixfmts[i].hal != fmt || choice--)
+            continue;
+        pix->pixelformat = heo_pixfmts[i].v4l2;
+        pix->width = w;
+        pix->height = h;
+        pix->bytesperline = 0;
+        pix->field = V4L2_FIELD_NONE;
+        *swap_rb = heo_pixfmts[i].swap_rb;
+        return 0;
     }
-    pix->width = w;
-    pix->height = h;
-    return 0;
+    return -1;
+}
+
+int v4l2_overlay_format_supported(int32_t fmt)
+{
+    struct v4l2_pix_format pix;
+    int swap_rb;
+
+    return configure_pixfmt(&pix, fmt, 0, 0, 0, &swap_rb) == 0;
 }
 
 static void configure_window(struct v4l2_window *win, int32_t w,
@@ -286,13 +323,28 @@ int v4l2_overlay_init(struct hwc_win_info_t_heo *win)
     LOGV("v4l2_overlay_init:: w=%d h=%d\n", format.fmt.pix.width,
          format.fmt.pix.height);
 
-    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-    configure_pixfmt(&format.fmt.pix, fmt, w, h);
-    LOGV("v4l2_overlay_init:: w=%d h=%d\n", format.fmt.pix.width,
-         format.fmt.pix.height);
-    ret = v4l2_overlay_ioctl(fd, VIDIOC_S_FMT, &format, "set output format");
+    /* the first choice the driver takes as it is */
+    for (int choice = 0; ; choice++) {
+        uint32_t want;
 
-    return ret;
+        format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        if (configure_pixfmt(&format.fmt.pix, fmt, w, h, choice, &win->swap_rb) < 0) {
+            LOGE("%s: heo takes no format for %d", __func__, fmt);
+            return -EINVAL;
+        }
+        want = format.fmt.pix.pixelformat;
+        if (ioctl(fd, VIDIOC_S_FMT, &format) == 0 &&
+                format.fmt.pix.pixelformat == want)
+            break;
+        LOGV("%s: heo refused %.4s for %d", __func__, (char *)&want, fmt);
+    }
+    LOGV("v4l2_overlay_init:: w=%d h=%d %.4s\n", format.fmt.pix.width,
+         format.fmt.pix.height, (char *)&format.fmt.pix.pixelformat);
+
+    win->v4l2_format = format.fmt.pix.pixelformat;
+    win->pitch = format.fmt.pix.bytesperline;
+
+    return 0;
 }
 
 int v4l2_overlay_get_input_size_and_format(int fd, uint32_t *w, uint32_t *h
@@ -514,6 +566,9 @@ int v4l2_overlay_stream_off(struct hwc_win_info_t_heo *win)
             LOGE("%s: Stream Off Failed!/%d", __func__, ret);
         } else {
             win->steamEn = false;
+            /* every queued buffer comes back with the stream off */
+            win->qd_buf_count = 0;
+            memset(win->buf_state, HEO_BUF_FREE, sizeof(win->buf_state));
         }
     } else {
         LOGV("%s: stream has already off");
@@ -522,36 +577,21 @@ int v4l2_overlay_stream_off(struct hwc_win_info_t_heo *win)
     return ret;
 }
 
-int v4l2_overlay_q_buf(int fd, int buffer, int zerocopy)
+/*
+ * Queues buffer index, one of ours mapped or, with userptr, the memory at
+ * userptr of length bytes for the HEO to fetch in place.
+ */
+int v4l2_overlay_q_buf(int fd, int index, const void *userptr, size_t length)
 {
     struct v4l2_buffer buf;
-    int ret = 0;;
 
-    if (zerocopy) {
-        /* TODO: the following code need to re-consider, we need a dma addr for softwarerender*/
-        uint8_t *pPhyYAddr;
-        uint8_t *pPhyCAddr;
-        struct fimc_buf fimc_src_buf;
-        uint8_t index;
-
-        memcpy(&pPhyYAddr, (void *) buffer, sizeof(pPhyYAddr));
-        memcpy(&pPhyCAddr, (void *) (buffer + sizeof(pPhyYAddr)),
-               sizeof(pPhyCAddr));
-        memcpy(&index,
-               (void *) (buffer + sizeof(pPhyYAddr) + sizeof(pPhyCAddr)),
-               sizeof(index));
-
-        fimc_src_buf.base[0] = (dma_addr_t) pPhyYAddr;
-        fimc_src_buf.base[1] = (dma_addr_t) pPhyCAddr;
-        fimc_src_buf.base[2] =
-            (dma_addr_t) (pPhyCAddr + (pPhyCAddr - pPhyYAddr)/4);
-
-        buf.index = index;
+    memset(&buf, 0, sizeof(buf));
+    buf.index = index;
+    if (userptr) {
         buf.memory      = V4L2_MEMORY_USERPTR;
-        buf.m.userptr   = (unsigned long)&fimc_src_buf;
-        buf.length      = 0;
+        buf.m.userptr   = (unsigned long)userptr;
+        buf.length      = length;
     } else {
-        buf.index = buffer;
         buf.memory      = V4L2_MEMORY_MMAP;
     }
 
@@ -582,3 +622,21 @@ int v4l2_overlay_dq_buf(int fd, int *index, int zerocopy)
     *index = buf.index;
     return 0;
 }
+
+/* 1 once a queued buffer is done and VIDIOC_DQBUF would not block */
+int v4l2_overlay_poll(int fd, int timeout)
+{
+    struct pollfd pfd;
+    int ret;
+
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+
+    ret = poll(&pfd, 1, timeout);
+    if (ret < 0) {
+        error(fd, "poll");
+        return -1;
+    }
+    return ret > 0 && (pfd.revents & POLLOUT) && !(pfd.revents & POLLERR);
+}
@@ -6,6 +6,11 @@
 #ifndef ANDROID_ZOOM_REPO_HARDWARE_SEC_LIBOVERLAY_V4L2_UTILS_H_
 #define ANDROID_ZOOM_REPO_HARDWARE_SEC_LIBOVERLAY_V4L2_UTILS_H_
 
+enum {
+    HEO_BUF_FREE = 0,       /* ours to fill */
+    HEO_BUF_QUEUED,         /* with the driver, waiting for or on screen */
+};
+
 struct hwc_win_info_t_heo {
     int        fd;
     int        size;
@@ -22,14 +27,42 @@ struct hwc_win_info_t_heo {
     int        blending;
     int        layer_index;
     uint32_t   layer_prev_buf;
+    int32_t    layer_prev_gen;
     int        set_win_flag;
     int        status;
     int        vsync;
     void*    base;
     uint32_t layer_prev_format;
 
-    bool      zero_copy;
+    bool      zero_copy;    /* layer buffers queued by user pointer */
     bool      steamEn;
+    int       direct_ok;    /* hwc.heo.direct, off once the driver refuses */
+
+    /* what configure_pixfmt got the driver to take */
+    uint32_t  v4l2_format;
+    uint32_t  pitch;        /* bytes per line of the buffers */
+    int       swap_rb;      /* RGBA layer into a BGRA format */
+    int       pending_copy; /* this frame: 1 to copy, -1 if that failed */
+
+    uint32_t  req_buffers;  /* queue depth to ask the driver for */
+
+    /* what the mapped buffers are for, kept while the window only moves
+     * or is off; the driver has one set per queue */
+    uint32_t  buf_format;   /* HAL format, 0 for none */
+    uint32_t  buf_width;
+    uint32_t  buf_height;
+    uint8_t   buf_state[MAX_NUM_OF_HEO_BUF];
+
+    /* direct buffers: the layer buffer queued at each index and our hold
+     * on it, see heo_hold_buffer; release_thread takes them back as the
+     * LCDC lets go. queue_lock covers the queue and these */
+    uint32_t  buf_handle[MAX_NUM_OF_HEO_BUF];
+    volatile int32_t *buf_hold[MAX_NUM_OF_HEO_BUF];
+    pthread_mutex_t queue_lock;
+    pthread_cond_t  queue_cond;
+    pthread_t release_thread;
+    int       release_threaded;
+    int       release_exit;
 
     struct fb_fix_screeninfo fix_info;
     struct fb_var_screeninfo lcd_info;
@@ -46,9 +79,11 @@ int v4l2_overlay_map_buf(int fd, int index, void **start, size_t *len);
 int v4l2_overlay_unmap_buf(void *start, size_t len);
 int v4l2_overlay_stream_on(struct hwc_win_info_t_heo *win);
 int v4l2_overlay_stream_off(struct hwc_win_info_t_heo *win);
-int v4l2_overlay_q_buf(int fd, int index, int zerocopy);
+int v4l2_overlay_q_buf(int fd, int index, const void *userptr, size_t length);
 int v4l2_overlay_dq_buf(int fd, int *index, int zerocopy);
+int v4l2_overlay_poll(int fd, int timeout);
 int v4l2_overlay_init(struct hwc_win_info_t_heo *win);
+int v4l2_overlay_format_supported(int32_t fmt);
 int v4l2_overlay_get_input_size(int fd, uint32_t *w, uint32_t *h,
                                 uint32_t *fmt);
 int v4l2_overlay_set_position(struct hwc_win_info_t_heo *win);
@@ -88,12 +123,6 @@ struct mapping_data {
     void *ptr;
 };
 
-typedef unsigned int dma_addr_t;
-struct fimc_buf {
-    dma_addr_t	base[3];
-    size_t		length[3];
-};
-
 #define ALL_BUFFERS_FLUSHED -66
 
 #endif  /* ANDROID_ZOOM_REPO_HARDWARE_SEC_LIBOVERLAY_V4L2_UTILS_H_*/
@@ -22,8 +22,9 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_SHARED_LIBRARIES += liblog \
                           libcutils
 LOCAL_MODULE_TAGS := optional
-LOCAL_SRC_FILES := copybit.cpp
+LOCAL_SRC_FILES := copybit.cpp ../hwcomposer/SamHWCblit.cpp
 LOCAL_MODULE := copybit.$(TARGET_BOOTLOADER_BOARD_NAME)
 LOCAL_C_INCLUDES += device/atmel/common/hardware/include \
-					device/atmel/common/hardware/sama5d3/libgralloc
+					device/atmel/common/hardware/sama5d3/libgralloc \
+					device/atmel/common/hardware/sama5d3/hwcomposer
 include $(BUILD_SHARED_LIBRARY)
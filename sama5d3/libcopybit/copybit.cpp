@@ -40,6 +40,7 @@
 #include "gralloc_priv.h"
 
 #include "copybit.h"
+#include "SamHWCblit.h"
 
 #define DEBUG_MDP_ERRORS 0
 
@@ -276,15 +277,7 @@ static int atmel_copybit(struct copybit_context_t *dev, void const *list)
             rd.y += (rd.h - rs.h) /2;
         uint8_t       * d = dst_bits + (rd.x + (l->req[i].dst.width) * rd.y) * bpp;
 
-        if (dbpr==sbpr && size==sbpr) {
-            size *= h;
-            h = 1;
-        }
-        do {
-            memcpy(d, s, size);
-            d += dbpr;
-            s += sbpr;
-        } while (--h > 0);
+        sam_blit_rows(d, dbpr, s, sbpr, size, h);
     }
     return 0;
 }
@@ -30,6 +30,7 @@
 #include <cutils/ashmem.h>
 #include <cutils/log.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 
 #include <hardware/hardware.h>
 #include <hardware/gralloc.h>
@@ -165,13 +166,16 @@ static int gralloc_alloc_framebuffer(alloc_device_t* dev,
     return err;
 }
 
+static volatile int32_t sGenerationBase;
+
 static int gralloc_alloc_buffer(alloc_device_t* dev,
         size_t size, int usage, buffer_handle_t* pHandle)
 {
     int err = 0;
     int fd = -1;
 
-    size = roundUpToPageSize(size);
+    // one more word past the pixels for the generation count
+    size = roundUpToPageSize(size + sizeof(int32_t));
     
     fd = ashmem_create_region("gralloc-buffer", size);
     if (fd < 0) {
@@ -180,11 +184,15 @@ static int gralloc_alloc_buffer(alloc_device_t* dev,
     }
 
     if (err == 0) {
-        private_handle_t* hnd = new private_handle_t(fd, size, 0);
+        private_handle_t* hnd = new private_handle_t(fd, size,
+                private_handle_t::PRIV_FLAGS_GENERATION);
         gralloc_module_t* module = reinterpret_cast<gralloc_module_t*>(
                 dev->common.module);
         err = mapBuffer(module, hnd);
         if (err == 0) {
+            // each buffer counts from its own base, so a handle reusing a
+            // freed one's address never looks unchanged to the hwcomposer
+            *hnd->generation() = android_atomic_add(1 << 16, &sGenerationBase);
             *pHandle = hnd;
         }
     }
@@ -196,6 +204,170 @@ static int gralloc_alloc_buffer(alloc_device_t* dev,
 
 /*****************************************************************************/
 
+/*
+ * Overlay buffers are carved out of the reserved memory of an overlay
+ * window, fb2 by default since the hwcomposer gives its highest window to
+ * the topmost layer. The hwcomposer keeps its own screens at the start;
+ * the lines past them are ours. A 32bpp buffer takes a line of the window
+ * per row, so the hwcomposer can show it by moving the window's yoffset.
+ * Others, YUV preview frames for the HEO, are packed into whole lines;
+ * what they get out of the pool is memory the LCDC can fetch directly,
+ * and a scanout() word to tell their producer when it does.
+ */
+static int gralloc_probe_overlay_locked(private_module_t* m)
+{
+    char value[PROPERTY_VALUE_MAX];
+    char name[64];
+    struct fb_fix_screeninfo finfo;
+    struct fb_var_screeninfo info;
+    uint32_t lcd_yres;
+    int fd;
+
+    if (m->ovl_probed)
+        return m->ovl_fd >= 0 ? 0 : -ENODEV;
+    m->ovl_probed = 1;
+    m->ovl_fd = -1;
+
+    property_get("ro.gralloc.ovl_pool", value, "2");
+    if (atoi(value) <= 0)
+        return -ENODEV;
+
+    /* the hwcomposer sizes its screens after the LCD */
+    fd = open("/dev/graphics/fb0", O_RDWR, 0);
+    if (fd < 0)
+        return -errno;
+    if (ioctl(fd, FBIOGET_VSCREENINFO, &info) == -1) {
+        close(fd);
+        return -errno;
+    }
+    lcd_yres = info.yres;
+    close(fd);
+
+    snprintf(name, 64, "/dev/graphics/fb%d", atoi(value));
+    fd = open(name, O_RDWR, 0);
+    if (fd < 0) {
+        LOGW("no overlay pool, can't open %s (%s)", name, strerror(errno));
+        return -ENODEV;
+    }
+
+    if (ioctl(fd, FBIOGET_FSCREENINFO, &finfo) == -1 ||
+            ioctl(fd, FBIOGET_VSCREENINFO, &info) == -1 ||
+            strcmp(finfo.id, "atmel_hlcdfb_ovl")) {
+        LOGW("no overlay pool, %s is not an overlay window", name);
+        close(fd);
+        return -ENODEV;
+    }
+
+    m->ovl_phys = finfo.smem_start;
+    m->ovl_pitch = info.xres_virtual * 4;
+    m->ovl_first = lcd_yres * OVL_POOL_RESERVED;
+    m->ovl_lines = finfo.smem_len / m->ovl_pitch;
+    if (m->ovl_lines <= m->ovl_first) {
+        LOGI("no overlay pool, %s has no memory past the hwcomposer's", name);
+        close(fd);
+        return -ENODEV;
+    }
+
+    m->ovl_fd = fd;
+    LOGI("overlay pool: %s, lines %u-%u of %u bytes", name,
+         m->ovl_first, m->ovl_lines - 1, m->ovl_pitch);
+    return 0;
+}
+
+static int gralloc_alloc_overlay_locked(alloc_device_t* dev,
+        int w, int h, int bpp, buffer_handle_t* pHandle, size_t* pStride)
+{
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            dev->common.module);
+    int err = gralloc_probe_overlay_locked(m);
+    if (err < 0)
+        return err;
+
+    if (bpp == 4) {
+        if (uint32_t(w) * 4 > m->ovl_pitch)
+            return -EINVAL;
+    } else {
+        // rows at the stride we were given and the scanout() word, as
+        // many lines as they fill
+        h = (*pStride * bpp * h + sizeof(int32_t) + m->ovl_pitch - 1) /
+                m->ovl_pitch;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < OVL_POOL_SLOTS; i++) {
+        if (!m->ovl_slots[i].lines) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0)
+        return -ENOMEM;
+
+    // first fit, stepping past every buffer in the way
+    uint32_t line = m->ovl_first;
+    bool moved = true;
+    while (moved) {
+        moved = false;
+        for (int i = 0; i < OVL_POOL_SLOTS; i++) {
+            const ovl_pool_slot* s = &m->ovl_slots[i];
+            if (s->lines && line < s->line + s->lines && s->line < line + h) {
+                line = s->line + s->lines;
+                moved = true;
+            }
+        }
+    }
+    if (line + h > m->ovl_lines)
+        return -ENOMEM;
+
+    private_handle_t* hnd = new private_handle_t(dup(m->ovl_fd),
+            m->ovl_pitch * h, private_handle_t::PRIV_FLAGS_OVERLAY |
+            (bpp == 4 ? 0 : private_handle_t::PRIV_FLAGS_SCANOUT));
+    hnd->offset = line * m->ovl_pitch;
+    hnd->uiPhys = m->ovl_phys + hnd->offset;
+    err = mapBuffer(reinterpret_cast<gralloc_module_t*>(m), hnd);
+    if (err < 0) {
+        close(hnd->fd);
+        delete hnd;
+        return err;
+    }
+    if (hnd->flags & private_handle_t::PRIV_FLAGS_SCANOUT)
+        *hnd->scanout() = 0;
+
+    m->ovl_slots[slot].line = line;
+    m->ovl_slots[slot].lines = h;
+    *pHandle = hnd;
+    if (bpp == 4)
+        *pStride = m->ovl_pitch / 4;
+    return 0;
+}
+
+static int gralloc_alloc_overlay(alloc_device_t* dev,
+        int w, int h, int bpp, buffer_handle_t* pHandle, size_t* pStride)
+{
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            dev->common.module);
+    pthread_mutex_lock(&m->lock);
+    int err = gralloc_alloc_overlay_locked(dev, w, h, bpp, pHandle, pStride);
+    pthread_mutex_unlock(&m->lock);
+    return err;
+}
+
+static void gralloc_free_overlay(alloc_device_t* dev,
+        private_handle_t const* hnd)
+{
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            dev->common.module);
+    pthread_mutex_lock(&m->lock);
+    for (int i = 0; i < OVL_POOL_SLOTS; i++) {
+        if (m->ovl_slots[i].lines &&
+                m->ovl_slots[i].line * m->ovl_pitch == uint32_t(hnd->offset))
+            m->ovl_slots[i].lines = 0;
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+/*****************************************************************************/
+
 static int gralloc_alloc(alloc_device_t* dev,
         int w, int h, int format, int usage,
         buffer_handle_t* pHandle, int* pStride)
@@ -233,7 +405,12 @@ static int gralloc_alloc(alloc_device_t* dev,
     int err;
     if (usage & GRALLOC_USAGE_HW_FB) {
         err = gralloc_alloc_framebuffer(dev, size, usage, pHandle);
+    } else if ((usage & GRALLOC_USAGE_SAM_OVERLAY) &&
+            (bpp == 4 || format == HAL_PIXEL_FORMAT_YCbCr_422_I) &&
+            gralloc_alloc_overlay(dev, w, h, bpp, pHandle, &stride) == 0) {
+        err = 0;
     } else {
+        // also overlay buffers, when the pool is missing or full
         err = gralloc_alloc_buffer(dev, size, usage, pHandle);
     }
 
@@ -244,6 +421,7 @@ static int gralloc_alloc(alloc_device_t* dev,
 	private_handle_t* hnd = (private_handle_t*) *pHandle;
 	hnd->iFormat = format;
 	hnd->uiBpp   = bpp * 8;
+	hnd->iStride = stride;
 	*pHandle = hnd;
     *pStride = stride;
     return 0;
@@ -266,6 +444,8 @@ static int gralloc_free(alloc_device_t* dev,
     } else { 
         gralloc_module_t* module = reinterpret_cast<gralloc_module_t*>(
                 dev->common.module);
+        if (hnd->flags & private_handle_t::PRIV_FLAGS_OVERLAY)
+            gralloc_free_overlay(dev, hnd);
         terminateBuffer(module, const_cast<private_handle_t*>(hnd));
     }
 
@@ -31,6 +31,18 @@
 
 /*****************************************************************************/
 
+/* buffer the hwcomposer can scan out in place, see gralloc_alloc_overlay */
+#define GRALLOC_USAGE_SAM_OVERLAY   GRALLOC_USAGE_PRIVATE_0
+
+#define OVL_POOL_SLOTS      8
+#define OVL_POOL_RESERVED   2   /* NUM_OF_WIN_BUF, in hwcomposer/common.h */
+#define OVL_SCANOUT_WAIT_MS 100 /* then gralloc_lock writes anyway */
+
+struct ovl_pool_slot {
+    uint32_t line;
+    uint32_t lines;             /* 0 when free */
+};
+
 struct private_module_t;
 struct private_handle_t;
 
@@ -51,6 +63,15 @@ struct private_module_t {
     float xdpi;
     float ydpi;
     float fps;
+
+    /* overlay scan-out pool, in lines of an overlay window's memory */
+    int ovl_probed;
+    int ovl_fd;
+    uint32_t ovl_phys;
+    uint32_t ovl_pitch;
+    uint32_t ovl_first;         /* past the hwcomposer's own screens */
+    uint32_t ovl_lines;
+    struct ovl_pool_slot ovl_slots[OVL_POOL_SLOTS];
 };
 
 /*****************************************************************************/
@@ -63,7 +84,11 @@ struct private_handle_t {
 #endif
     
     enum {
-        PRIV_FLAGS_FRAMEBUFFER = 0x00000001
+        PRIV_FLAGS_FRAMEBUFFER = 0x00000001,
+        PRIV_FLAGS_OVERLAY     = 0x00000002,
+        PRIV_FLAGS_GENERATION  = 0x00000004,   // see generation()
+        PRIV_FLAGS_WRITING     = 0x00000008,   // locked for write, this process
+        PRIV_FLAGS_SCANOUT     = 0x00000010    // see scanout()
     };
 
     // file-descriptors
@@ -81,15 +106,18 @@ struct private_handle_t {
 	int     iFormat;
 	//Note: bits per pixel (32 for RGBA8888)
 	int    uiBpp;
+	//Note: pixels per line, and the physical address of overlay buffers
+	int     iStride;
+	int     uiPhys;
 
 #ifdef __cplusplus
-    static const int sNumInts = 8;
+    static const int sNumInts = 10;
     static const int sNumFds = 1;
     static const int sMagic = 0x3141592;
 
     private_handle_t(int fd, int size, int flags) :
         fd(fd), magic(sMagic), flags(flags), size(size), offset(0),
-        base(0), pid(getpid())
+        base(0), pid(getpid()), iStride(0), uiPhys(0)
     {
         version = sizeof(native_handle);
         numInts = sNumInts;
@@ -99,6 +127,19 @@ struct private_handle_t {
         magic = 0;
     }
 
+    // the last word of the mapping, shared by every process that has the
+    // buffer mapped and bumped by gralloc_unlock after each CPU write
+    volatile int32_t* generation() const {
+        return (volatile int32_t*)(base + size - sizeof(int32_t));
+    }
+
+    // the last word of a YUV pool buffer, past its rows: non-zero while
+    // the hwcomposer has it queued to the HEO, which fetches it in place.
+    // gralloc_lock waits for it to clear before a CPU write
+    volatile int32_t* scanout() const {
+        return (volatile int32_t*)(base + size - sizeof(int32_t));
+    }
+
     static int validate(const native_handle* h) {
         const private_handle_t* hnd = (const private_handle_t*)h;
         if (!h || h->version != sizeof(native_handle) ||
@@ -31,6 +31,7 @@
 #include <hardware/gralloc.h>
 
 #include "gralloc_priv.h"
+#include "gr.h"
 
 
 /* desktop Linux needs a little help with gettid() */
@@ -50,13 +51,19 @@ static int gralloc_map(gralloc_module_t const* module,
     private_handle_t* hnd = (private_handle_t*)handle;
     if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
         size_t size = hnd->size;
+        off_t offset = 0;
+        if (hnd->flags & private_handle_t::PRIV_FLAGS_OVERLAY) {
+            // a slice of the overlay window's memory, from its page on
+            offset = hnd->offset & ~(PAGE_SIZE-1);
+            size += hnd->offset - offset;
+        }
         void* mappedAddress = mmap(0, size,
-                PROT_READ|PROT_WRITE, MAP_SHARED, hnd->fd, 0);
+                PROT_READ|PROT_WRITE, MAP_SHARED, hnd->fd, offset);
         if (mappedAddress == MAP_FAILED) {
             LOGE("Could not mmap %s", strerror(errno));
             return -errno;
         }
-        hnd->base = intptr_t(mappedAddress) + hnd->offset;
+        hnd->base = intptr_t(mappedAddress) + hnd->offset - offset;
         //LOGD("gralloc_map() succeeded fd=%d, off=%d, size=%d, vaddr=%p",
         //        hnd->fd, hnd->offset, hnd->size, mappedAddress);
     }
@@ -71,6 +78,10 @@ static int gralloc_unmap(gralloc_module_t const* module,
     if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
         void* base = (void*)hnd->base;
         size_t size = hnd->size;
+        if (hnd->flags & private_handle_t::PRIV_FLAGS_OVERLAY) {
+            base = (void*)(hnd->base - (hnd->offset & (PAGE_SIZE-1)));
+            size += hnd->offset & (PAGE_SIZE-1);
+        }
         //LOGD("unmapping from %p, size=%d", base, size);
         if (munmap(base, size) < 0) {
             LOGE("Could not unmap %s", strerror(errno));
@@ -153,6 +164,22 @@ int gralloc_lock(gralloc_module_t const* module,
         return -EINVAL;
 
     private_handle_t* hnd = (private_handle_t*)handle;
+    if ((usage & GRALLOC_USAGE_SW_WRITE_MASK) &&
+            (hnd->flags & private_handle_t::PRIV_FLAGS_SCANOUT) && hnd->base) {
+        // the HEO may still be fetching it, until the hwcomposer takes it
+        // back from the driver, within a frame or so
+        int waited = 0;
+        while (android_atomic_acquire_load(hnd->scanout()) &&
+                waited < OVL_SCANOUT_WAIT_MS) {
+            usleep(1000);
+            waited++;
+        }
+        LOGW_IF(waited == OVL_SCANOUT_WAIT_MS,
+                "buffer still scanned out after %d ms, writing", waited);
+    }
+    if ((usage & GRALLOC_USAGE_SW_WRITE_MASK) &&
+            (hnd->flags & private_handle_t::PRIV_FLAGS_GENERATION))
+        hnd->flags |= private_handle_t::PRIV_FLAGS_WRITING;
     *vaddr = (void*)hnd->base;
     return 0;
 }
@@ -160,10 +187,16 @@ int gralloc_lock(gralloc_module_t const* module,
 int gralloc_unlock(gralloc_module_t const* module, 
         buffer_handle_t handle)
 {
-    // we're done with a software buffer. nothing to do in this
-    // implementation. typically this is used to flush the data cache.
+    // we're done with a software buffer. typically this is used to flush
+    // the data cache. after a write, tell the hwcomposer the content changed.
 
     if (private_handle_t::validate(handle) < 0)
         return -EINVAL;
+
+    private_handle_t* hnd = (private_handle_t*)handle;
+    if ((hnd->flags & private_handle_t::PRIV_FLAGS_WRITING) && hnd->base) {
+        hnd->flags &= ~private_handle_t::PRIV_FLAGS_WRITING;
+        android_atomic_inc(hnd->generation());
+    }
     return 0;
 }
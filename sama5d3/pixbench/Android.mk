@@ -0,0 +1,45 @@
+# Copyright (C) 2008 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH:= $(call my-dir)
+
+PIXBENCH_SRC_FILES := \
+    pixbench.cpp \
+    pixverify.cpp \
+    ../camera/CameraConvert.cpp \
+    ../camera/CameraStats.cpp \
+    ../camera/cctables.cpp \
+    ../camera/ccrgb16toyuv420.cpp \
+    ../hwcomposer/SamHWCblit.cpp
+
+PIXBENCH_C_INCLUDES := \
+    $(LOCAL_PATH)/../camera \
+    $(LOCAL_PATH)/../hwcomposer
+
+# on the board, where the numbers matter
+include $(CLEAR_VARS)
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := $(PIXBENCH_SRC_FILES)
+LOCAL_C_INCLUDES += $(PIXBENCH_C_INCLUDES)
+LOCAL_MODULE := pixbench
+include $(BUILD_EXECUTABLE)
+
+# on the build host, to compare changes quickly
+include $(CLEAR_VARS)
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := $(PIXBENCH_SRC_FILES)
+LOCAL_C_INCLUDES += $(PIXBENCH_C_INCLUDES)
+LOCAL_LDLIBS += -lrt
+LOCAL_MODULE := pixbench
+include $(BUILD_HOST_EXECUTABLE)
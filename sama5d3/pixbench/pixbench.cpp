@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Throughput of the CPU pixel paths of the camera, hwcomposer and copybit
+ * HALs, at the resolutions this board runs. The kernels are linked from
+ * the HAL sources themselves, so a change there shows up here unchanged.
+ *
+ *   pixbench [-t ms] [-r WxH] [-f fbdev] [name...]
+ *   pixbench -v [-s seed]
+ *
+ * Each kernel runs for at least -t milliseconds per round (default 200),
+ * best of five rounds, and reports megapixels and megabytes (read plus
+ * written) per second. Both are per pixel of the frame, also for the
+ * kernels that only touch part of it.
+ *
+ * The blit_* kernels copy an RGBA8888 layer into an overlay window with
+ * each engine of SamHWCblit. The window is a shared mapping standing in
+ * for one, or with -f the real thing, e.g. -f /dev/graphics/fb1 on the
+ * board for its write-combined memory (the window shows the noise).
+ *
+ * -v checks the output of every kernel against its reference instead,
+ * see pixverify.cpp, and exits non-zero on any difference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "CameraConvert.h"
+#include "CameraStats.h"
+#include "ccrgb16toyuv420.h"
+#include "SamHWCblit.h"
+#include "pixverify.h"
+
+#define ROUNDS          5
+#define FB_WIDTH        800     /* copybit destination, the LCD */
+#define FB_HEIGHT       480
+
+struct resolution {
+    int width;
+    int height;
+};
+
+static const struct resolution sResolutions[] = {
+    { 320, 240 },
+    { 480, 272 },
+    { 640, 480 },
+    { 800, 480 },
+};
+
+struct bench_ctx {
+    int width;
+    int height;
+    uint8_t *src;
+    uint8_t *dst;
+    uint8_t *fb;            /* overlay window memory, FB_WIDTH 32bpp lines */
+    CCRGB16toYUV420 *cc;
+    sam_blit_fn blit;
+};
+
+struct kernel {
+    const char *name;
+    int src_bpp16;          /* bytes touched per pixel, in 1/16ths */
+    int dst_bpp16;
+    int (*setup)(struct bench_ctx *ctx);
+    void (*run)(struct bench_ctx *ctx);
+};
+
+/*****************************************************************************/
+
+static void run_yuy2_to_yv12(struct bench_ctx *ctx)
+{
+    yuyv_to_i420(ctx->src, ctx->dst, ctx->width, ctx->height);
+}
+
+static void run_yuyv_to_nv21(struct bench_ctx *ctx)
+{
+    yuyv_to_nv21(ctx->src, ctx->dst, ctx->width, ctx->height);
+}
+
+static void run_yuyv_to_yv12(struct bench_ctx *ctx)
+{
+    yuyv_to_yv12(ctx->src, ctx->dst, ctx->width, ctx->height);
+}
+
+static void run_convert(struct bench_ctx *ctx)
+{
+    uyvy_to_rgb565(ctx->src, ctx->dst, ctx->width, ctx->height);
+}
+
+static void run_jpeg_rgb(struct bench_ctx *ctx)
+{
+    for (int line = 0; line < ctx->height; line++)
+        yvyu_to_rgb888_line(ctx->src + line * ctx->width * 2,
+                            ctx->dst + line * ctx->width * 3, ctx->width);
+}
+
+/* the preview thread runs these on every frame, see CameraStats.h */
+static void run_sharpness(struct bench_ctx *ctx)
+{
+    *(volatile uint32_t *)ctx->dst = yuyv_sharpness(ctx->src, ctx->width, ctx->height);
+}
+
+static void run_exposure_stats(struct bench_ctx *ctx)
+{
+    yuyv_exposure_stats(ctx->src, ctx->width, ctx->height,
+                        (struct yuyv_stats *)ctx->dst);
+}
+
+static int setup_cc(struct bench_ctx *ctx, int rotation, int mode)
+{
+    int w = ctx->width, h = ctx->height;
+    int dw = (rotation & 1) ? h : w;
+    int dh = (rotation & 1) ? w : h;
+
+    ctx->cc = CCRGB16toYUV420::New();
+    if (!ctx->cc)
+        return -1;
+    if (!ctx->cc->Init(w, h, w, dw, dh, dw, rotation) || !ctx->cc->SetMode(mode))
+        return -1;
+    return 0;
+}
+
+static int setup_cc_plain(struct bench_ctx *ctx)
+{
+    return setup_cc(ctx, 0, 0);
+}
+
+static int setup_cc_rotate(struct bench_ctx *ctx)
+{
+    return setup_cc(ctx, 1, 1);
+}
+
+static void run_cc(struct bench_ctx *ctx)
+{
+    ctx->cc->Convert(ctx->src, ctx->dst);
+}
+
+/* full layer, the window copy collapses to one memcpy */
+static void run_hwc_full(struct bench_ctx *ctx)
+{
+    size_t pitch = ctx->width * 2;
+
+    sam_blit_rows(ctx->dst, pitch, ctx->src, pitch, pitch, ctx->height);
+}
+
+/* left half visible, row by row out of the layer */
+static void run_hwc_rect(struct bench_ctx *ctx)
+{
+    size_t pitch = ctx->width * 2;
+
+    sam_blit_rows(ctx->dst, pitch / 2, ctx->src, pitch, pitch / 2, ctx->height);
+}
+
+/* RGB565 image into the middle of the framebuffer */
+static void run_copybit(struct bench_ctx *ctx)
+{
+    size_t dpitch = FB_WIDTH * 2;
+    int x = (FB_WIDTH - ctx->width) / 2;
+    int y = (FB_HEIGHT - ctx->height) / 2;
+
+    sam_blit_rows(ctx->dst + y * dpitch + x * 2, dpitch,
+                  ctx->src, ctx->width * 2, ctx->width * 2, ctx->height);
+}
+
+static int setup_blit(struct bench_ctx *ctx, int engine)
+{
+    ctx->blit = sam_blit_engine(engine);
+    return ctx->blit ? 0 : -1;
+}
+
+static int setup_blit_memcpy(struct bench_ctx *ctx)
+{
+    return setup_blit(ctx, SAM_BLIT_MEMCPY);
+}
+
+static int setup_blit_words(struct bench_ctx *ctx)
+{
+    return setup_blit(ctx, SAM_BLIT_WORDS);
+}
+
+static int setup_blit_neon(struct bench_ctx *ctx)
+{
+    return setup_blit(ctx, SAM_BLIT_NEON);
+}
+
+/* RGBA8888 layer into the top left of the window, row by row below 800 */
+static void run_blit(struct bench_ctx *ctx)
+{
+    ctx->blit(ctx->fb, FB_WIDTH * 4, ctx->src, ctx->width * 4,
+              ctx->width * 4, ctx->height);
+}
+
+static const struct kernel sKernels[] = {
+    { "YUY2toYV12",       32, 24, NULL,            run_yuy2_to_yv12 },
+    { "yuyv_to_nv21",     32, 24, NULL,            run_yuyv_to_nv21 },
+    { "yuyv_to_yv12",     32, 24, NULL,            run_yuyv_to_yv12 },
+    { "convert",          32, 32, NULL,            run_convert },
+    { "CCRGB16toYUV420",  32, 24, setup_cc_plain,  run_cc },
+    { "CCRGB16toYUV420/r",32, 24, setup_cc_rotate, run_cc },
+    { "jpeg_rgb",         32, 48, NULL,            run_jpeg_rgb },
+    /* every 4th line of the centre quarter and the one below it */
+    { "yuyv_sharpness",    4,  0, NULL,            run_sharpness },
+    /* a macropixel per 8x8 pixels */
+    { "yuyv_exposure_stats", 1, 0, NULL,           run_exposure_stats },
+    { "copy_src_content", 32, 32, NULL,            run_hwc_full },
+    { "copy_src_rect",    16, 16, NULL,            run_hwc_rect },
+    { "atmel_copybit",    32, 32, NULL,            run_copybit },
+    { "blit_memcpy",      64, 64, setup_blit_memcpy, run_blit },
+    { "blit_words",       64, 64, setup_blit_words, run_blit },
+    { "blit_neon",        64, 64, setup_blit_neon, run_blit },
+};
+
+#define NUM_KERNELS     (int)(sizeof(sKernels) / sizeof(sKernels[0]))
+#define NUM_RESOLUTIONS (int)(sizeof(sResolutions) / sizeof(sResolutions[0]))
+
+/*****************************************************************************/
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* best time per call, in nanoseconds */
+static double time_kernel(const struct kernel *k, struct bench_ctx *ctx, int min_ms)
+{
+    double best = 0;
+
+    k->run(ctx);    /* warm the caches and the tables */
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int64_t start = now_ns(), elapsed;
+        long calls = 0;
+
+        do {
+            k->run(ctx);
+            calls++;
+            elapsed = now_ns() - start;
+        } while (elapsed < (int64_t)min_ms * 1000000);
+
+        double per_call = (double)elapsed / calls;
+        if (!round || per_call < best)
+            best = per_call;
+    }
+    return best;
+}
+
+static bool selected(const char *name, int argc, char **argv, int first)
+{
+    if (first >= argc)
+        return true;
+    for (int i = first; i < argc; i++)
+        if (!strcmp(argv[i], name))
+            return true;
+    return false;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t ms] [-r WxH] [-f fbdev] [name...]\n"
+                    "       %s -v [-s seed]\n", prog, prog);
+    for (int i = 0; i < NUM_KERNELS; i++)
+        fprintf(stderr, "  %s\n", sKernels[i].name);
+}
+
+int main(int argc, char **argv)
+{
+    struct resolution res[NUM_RESOLUTIONS];
+    int num_res = NUM_RESOLUTIONS;
+    int min_ms = 200;
+    bool verify = false;
+    unsigned seed = 1;
+    int arg = 1;
+    size_t buf_size;
+    uint8_t *src, *dst, *fb;
+    const char *fbdev = NULL;
+
+    memcpy(res, sResolutions, sizeof(res));
+
+    while (arg < argc && argv[arg][0] == '-') {
+        if (!strcmp(argv[arg], "-v")) {
+            verify = true;
+            arg++;
+            continue;
+        } else if (!strcmp(argv[arg], "-s") && arg + 1 < argc) {
+            seed = strtoul(argv[arg + 1], NULL, 0);
+        } else if (!strcmp(argv[arg], "-f") && arg + 1 < argc) {
+            fbdev = argv[arg + 1];
+        } else if (!strcmp(argv[arg], "-t") && arg + 1 < argc) {
+            min_ms = atoi(argv[arg + 1]);
+        } else if (!strcmp(argv[arg], "-r") && arg + 1 < argc &&
+                   sscanf(argv[arg + 1], "%dx%d", &res[0].width, &res[0].height) == 2 &&
+                   res[0].width > 0 && res[0].height > 0 &&
+                   res[0].width <= FB_WIDTH && res[0].height <= FB_HEIGHT &&
+                   !(res[0].width & 15) && !(res[0].height & 1)) {
+            num_res = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        arg += 2;
+    }
+
+    if (verify)
+        return pixverify(seed);
+
+    /* big enough for any kernel at the largest size, and the framebuffer */
+    buf_size = FB_WIDTH * FB_HEIGHT * 4;
+    src = (uint8_t *)malloc(buf_size);
+    dst = (uint8_t *)malloc(buf_size);
+    if (!src || !dst) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    if (fbdev) {
+        int fd = open(fbdev, O_RDWR);
+
+        fb = fd < 0 ? (uint8_t *)MAP_FAILED :
+             (uint8_t *)mmap(0, buf_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (fd >= 0)
+            close(fd);
+    } else {
+        fb = (uint8_t *)mmap(0, buf_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    }
+    if (fb == MAP_FAILED) {
+        fprintf(stderr, "can't map %s\n", fbdev ? fbdev : "the window");
+        return 1;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < buf_size; i++)
+        src[i] = rand();
+    memset(dst, 0, buf_size);
+
+    printf("%-20s %9s %10s %10s %10s\n", "kernel", "size", "us/frame", "MPix/s", "MB/s");
+
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        const struct kernel *k = &sKernels[i];
+
+        if (!selected(k->name, argc, argv, arg))
+            continue;
+
+        for (int r = 0; r < num_res; r++) {
+            struct bench_ctx ctx;
+            char size[16];
+
+            memset(&ctx, 0, sizeof(ctx));
+            ctx.width = res[r].width;
+            ctx.height = res[r].height;
+            ctx.src = src;
+            ctx.dst = dst;
+            ctx.fb = fb;
+            snprintf(size, sizeof(size), "%dx%d", ctx.width, ctx.height);
+
+            if (k->setup && k->setup(&ctx) < 0) {
+                printf("%-20s %9s %10s\n", k->name, size, "n/a");
+                delete ctx.cc;
+                continue;
+            }
+
+            double ns = time_kernel(k, &ctx, min_ms);
+            double pixels = (double)ctx.width * ctx.height;
+            double bytes = pixels * (k->src_bpp16 + k->dst_bpp16) / 16;
+
+            printf("%-20s %9s %10.1f %10.2f %10.2f\n", k->name, size,
+                   ns / 1000, pixels * 1000 / ns, bytes * 1000 / ns);
+
+            delete ctx.cc;
+        }
+    }
+
+    munmap(fb, buf_size);
+    free(src);
+    free(dst);
+    return 0;
+}
@@ -0,0 +1,663 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * pixbench -v: every kernel pixbench times, checked bit for bit against
+ * a plain scalar reference written from the format definitions, not from
+ * the kernel. Optimised versions of a kernel have to keep passing this.
+ *
+ * Destination buffers are filled with the same noise for kernel and
+ * reference, so bytes a kernel must leave alone (YV12 padding, colour
+ * keyed pixels, pitch gaps) are checked too, and a guard area after the
+ * frame catches overruns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "CameraConvert.h"
+#include "cctables.h"
+#include "ccrgb16toyuv420.h"
+#include "SamHWCblit.h"
+#include "pixverify.h"
+
+#define GUARD           64
+
+enum {
+    PATTERN_RANDOM = 0,
+    PATTERN_ZERO,
+    PATTERN_FULL,
+    PATTERN_EXTREME,    /* only the values that clip hardest */
+    PATTERN_MAX,
+};
+
+static const char *sPatternNames[PATTERN_MAX] = {
+    "random", "zero", "full", "extreme",
+};
+
+static uint32_t sSeed;
+static int sChecks;
+static int sFailures;
+
+/* our own generator, so a seed means the same images on every libc */
+static uint32_t next_rand(void)
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return sSeed >> 8;
+}
+
+static void fill_noise(uint8_t *buf, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        buf[i] = next_rand();
+}
+
+static void fill_pattern(uint8_t *buf, size_t size, int pattern)
+{
+    static const uint8_t extremes[] = { 0, 16, 235, 240, 255 };
+
+    for (size_t i = 0; i < size; i++) {
+        switch (pattern) {
+        case PATTERN_ZERO:
+            buf[i] = 0;
+            break;
+        case PATTERN_FULL:
+            buf[i] = 0xff;
+            break;
+        case PATTERN_EXTREME:
+            buf[i] = extremes[next_rand() % sizeof(extremes)];
+            break;
+        default:
+            buf[i] = next_rand();
+            break;
+        }
+    }
+}
+
+/* RGB565 words; the extremes are black, white and the primaries */
+static void fill_pattern16(uint16_t *buf, size_t count, int pattern)
+{
+    static const uint16_t extremes[] = { 0x0000, 0xffff, 0xf800, 0x07e0, 0x001f };
+
+    if (pattern != PATTERN_EXTREME) {
+        fill_pattern((uint8_t *)buf, count * 2, pattern);
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+        buf[i] = extremes[next_rand() % (sizeof(extremes) / sizeof(extremes[0]))];
+}
+
+/* kernel output vs reference output, over the frame and the guard */
+static void check(const char *name, int width, int height, const char *what,
+                  const uint8_t *got, const uint8_t *want, size_t size)
+{
+    sChecks++;
+    for (size_t i = 0; i < size + GUARD; i++) {
+        if (got[i] != want[i]) {
+            sFailures++;
+            printf("FAIL %-18s %4dx%-4d %-24s byte %lu%s: got %u, want %u\n",
+                   name, width, height, what, (unsigned long)i,
+                   i >= size ? " (past the end)" : "", got[i], want[i]);
+            return;
+        }
+    }
+}
+
+/* two copies of the same noise, sized for the frame plus the guard */
+static void alloc_pair(size_t size, uint8_t **got, uint8_t **want)
+{
+    *got = (uint8_t *)malloc(size + GUARD);
+    *want = (uint8_t *)malloc(size + GUARD);
+    if (!*got || !*want) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    fill_noise(*got, size + GUARD);
+    memcpy(*want, *got, size + GUARD);
+}
+
+/*****************************************************************************/
+/* YUYV repacking */
+
+static void ref_yuyv_to_i420(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    uint8_t *u = dst + width * height;
+    uint8_t *v = u + (width / 2) * (height / 2);
+
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            dst[y * width + x] = src[(y * width + x) * 2];
+
+    for (int y = 0; y < height; y += 2)
+        for (int x = 0; x < width; x += 2) {
+            const uint8_t *p = src + (y * width + x) * 2;
+            int c = (y / 2) * (width / 2) + x / 2;
+
+            u[c] = p[1];
+            v[c] = p[3];
+        }
+}
+
+/* Y at y_stride, U and V of each 2x2 block averaged (rounding up) */
+static void ref_yuyv_to_420(const uint8_t *src, int width, int height,
+                            uint8_t *y_plane, int y_stride,
+                            uint8_t *u_plane, uint8_t *v_plane,
+                            int c_stride, int c_step)
+{
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            y_plane[y * y_stride + x] = src[(y * width + x) * 2];
+
+    for (int y = 0; y < height; y += 2)
+        for (int x = 0; x < width; x += 2) {
+            const uint8_t *p0 = src + (y * width + x) * 2;
+            const uint8_t *p1 = p0 + width * 2;
+            int c = (y / 2) * c_stride + (x / 2) * c_step;
+
+            u_plane[c] = (p0[1] + p1[1] + 1) / 2;
+            v_plane[c] = (p0[3] + p1[3] + 1) / 2;
+        }
+}
+
+static void ref_yuyv_to_nv21(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    uint8_t *vu = dst + width * height;
+
+    ref_yuyv_to_420(src, width, height, dst, width, vu + 1, vu, width, 2);
+}
+
+static void ref_yuyv_to_yv12(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    int stride = (width + 15) & ~15;
+    int c_stride = (stride / 2 + 15) & ~15;
+    uint8_t *v = dst + stride * height;
+    uint8_t *u = v + c_stride * (height / 2);
+
+    ref_yuyv_to_420(src, width, height, dst, stride, u, v, c_stride, 1);
+}
+
+/*****************************************************************************/
+/* YUV to RGB, BT.601 in 10 bit fixed point, straight from the formula */
+
+static int clamp255(int x)
+{
+    return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
+
+static void ref_yuv_to_rgb(int y, int u, int v, int *r, int *g, int *b)
+{
+    int luma = 1192 * (y - 16);
+
+    *r = clamp255((luma + 1634 * (v - 128)) >> 10);
+    *g = clamp255((luma - 833 * (v - 128) - 400 * (u - 128)) >> 10);
+    *b = clamp255((luma + 2066 * (u - 128)) >> 10);
+}
+
+static void ref_uyvy_to_rgb565(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    for (int i = 0; i < width * height; i++) {
+        const uint8_t *p = src + (i & ~1) * 2;
+        int r, g, b, rgb;
+
+        ref_yuv_to_rgb(p[(i & 1) ? 3 : 1], p[0], p[2], &r, &g, &b);
+        rgb = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        dst[i * 2] = rgb & 0xff;
+        dst[i * 2 + 1] = rgb >> 8;
+    }
+}
+
+static void ref_yvyu_to_rgb888(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    for (int i = 0; i < width * height; i++) {
+        const uint8_t *p = src + (i & ~1) * 2;
+        int r, g, b;
+
+        ref_yuv_to_rgb(p[(i & 1) ? 2 : 0], p[3], p[1], &r, &g, &b);
+        dst[i * 3] = r;
+        dst[i * 3 + 1] = g;
+        dst[i * 3 + 2] = b;
+    }
+}
+
+static void run_yvyu_to_rgb888(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    for (int y = 0; y < height; y++)
+        yvyu_to_rgb888_line(src + y * width * 2, dst + y * width * 3, width);
+}
+
+struct yuyv_kernel {
+    const char *name;
+    void (*run)(const uint8_t *src, uint8_t *dst, int width, int height);
+    void (*ref)(const uint8_t *src, uint8_t *dst, int width, int height);
+    int (*size)(int width, int height);
+};
+
+static int i420_size(int width, int height)
+{
+    return width * height * 3 / 2;
+}
+
+static int rgb565_size(int width, int height)
+{
+    return width * height * 2;
+}
+
+static int rgb888_size(int width, int height)
+{
+    return width * height * 3;
+}
+
+static const struct yuyv_kernel sYuyvKernels[] = {
+    { "YUY2toYV12",   yuyv_to_i420,       ref_yuyv_to_i420,   i420_size },
+    { "yuyv_to_nv21", yuyv_to_nv21,       ref_yuyv_to_nv21,   nv21_frame_size },
+    { "yuyv_to_yv12", yuyv_to_yv12,       ref_yuyv_to_yv12,   yv12_frame_size },
+    { "convert",      uyvy_to_rgb565,     ref_uyvy_to_rgb565, rgb565_size },
+    { "jpeg_rgb",     run_yvyu_to_rgb888, ref_yvyu_to_rgb888, rgb888_size },
+};
+
+/* widths off the 8 and 16 pixel SIMD steps, down to a single pair */
+static const int sYuyvSizes[][2] = {
+    { 2, 2 }, { 6, 4 }, { 16, 2 }, { 18, 6 }, { 34, 10 }, { 46, 2 },
+    { 178, 144 }, { 320, 240 }, { 800, 480 },
+};
+
+static void verify_yuyv(void)
+{
+    for (unsigned k = 0; k < sizeof(sYuyvKernels) / sizeof(sYuyvKernels[0]); k++) {
+        const struct yuyv_kernel *kernel = &sYuyvKernels[k];
+
+        for (unsigned s = 0; s < sizeof(sYuyvSizes) / sizeof(sYuyvSizes[0]); s++) {
+            int width = sYuyvSizes[s][0], height = sYuyvSizes[s][1];
+            size_t size = kernel->size(width, height);
+            uint8_t *src = (uint8_t *)malloc(width * height * 2);
+            uint8_t *got, *want;
+
+            for (int pattern = 0; pattern < PATTERN_MAX; pattern++) {
+                fill_pattern(src, width * height * 2, pattern);
+                alloc_pair(size, &got, &want);
+
+                kernel->run(src, got, width, height);
+                kernel->ref(src, want, width, height);
+                check(kernel->name, width, height, sPatternNames[pattern],
+                      got, want, size);
+
+                free(got);
+                free(want);
+            }
+            free(src);
+        }
+    }
+}
+
+/*****************************************************************************/
+/* RGB565 to YUV420, CCRGB16toYUV420 */
+
+#define CC_ALPHA        413     /* 0.0722 / 0.7152 in Q12 */
+#define CC_BETA         1218    /* 0.2126 / 0.7152 in Q12 */
+
+static uint8_t ref_rgb16_luma(uint16_t p)
+{
+    int rb = (CC_ALPHA * (p & 0x1f) + CC_BETA * (p >> 11)) >> 9;
+
+    return cc_rgb16_y_table[rb + ((p >> 3) & 0xfc)];
+}
+
+/* chroma of the average of count pixels, components summed in Q5 */
+static void ref_rgb16_chroma(int r, int g, int b, int count, uint8_t *cb, uint8_t *cr)
+{
+    r /= count;
+    g /= count;
+    b /= count;
+
+    *cb = CC_RGB16_CB((((b - g) << 16) + 19525 * (b - r)) >> 18);
+    *cr = CC_RGB16_CR((((r - g) << 16) - 6640 * (b - r)) >> 18);
+}
+
+struct cc_case {
+    int src_width, src_height, src_pitch;
+    int dst_width, dst_height, dst_pitch;
+    int rotation;
+    bool color_key;
+};
+
+/*
+ * The displayed image: the source read bottom up if asked, mirrored if
+ * CCFLIP, rotated, then scaled to the output with the nearest, centre
+ * aligned sample. Flips and rotations are all done at source resolution.
+ */
+static uint16_t ref_sample(const uint16_t *src, const struct cc_case *c, int x, int y)
+{
+    int rot = c->rotation & CCROTATE_CLKWISE;
+    bool swap = rot & 1;
+    int rw = swap ? c->src_height : c->src_width;     /* rotated, full size */
+    int rh = swap ? c->src_width : c->src_height;
+    int u = ((2 * x + 1) * rw) / (2 * c->dst_width);
+    int v = ((2 * y + 1) * rh) / (2 * c->dst_height);
+    int sx, sy;
+
+    switch (rot) {
+    case CCROTATE_CNTRCLKWISE:
+        sx = c->src_width - 1 - v;
+        sy = u;
+        break;
+    case CCROTATE_180:
+        sx = c->src_width - 1 - u;
+        sy = c->src_height - 1 - v;
+        break;
+    case CCROTATE_CLKWISE:
+        sx = v;
+        sy = c->src_height - 1 - u;
+        break;
+    default:
+        sx = u;
+        sy = v;
+        break;
+    }
+
+    /* undo the mirror and the bottom up storage */
+    if (c->rotation & CCFLIP)
+        sx = c->src_width - 1 - sx;
+    if (c->rotation & CCBOTTOM_UP)
+        sy = c->src_height - 1 - sy;
+
+    return src[sy * c->src_pitch + sx];
+}
+
+/*
+ * Y plane, then U and V at a quarter of the Y plane each, with the
+ * chroma pitch half the luma pitch. Colour keyed pixels keep whatever
+ * luma was there and blend the chroma of the others into the old one.
+ */
+static void ref_rgb16_to_yuv420(const uint16_t *src, const struct cc_case *c,
+                                uint16_t key, uint8_t *dst)
+{
+    int pitch = c->dst_pitch;
+    uint8_t *u_plane = dst + pitch * c->dst_height;
+    uint8_t *v_plane = u_plane + (pitch * c->dst_height) / 4;
+
+    for (int y = 0; y < c->dst_height; y += 2) {
+        for (int x = 0; x < c->dst_width; x += 2) {
+            int r = 0, g = 0, b = 0, count = 0;
+            uint8_t *u = u_plane + (y / 2) * (pitch / 2) + x / 2;
+            uint8_t *v = v_plane + (y / 2) * (pitch / 2) + x / 2;
+            uint8_t cb, cr;
+
+            for (int k = 0; k < 4; k++) {
+                int px = x + (k & 1), py = y + (k >> 1);
+                uint16_t p = ref_sample(src, c, px, py);
+
+                if (c->color_key && p == key)
+                    continue;
+
+                dst[py * pitch + px] = ref_rgb16_luma(p);
+                r += ((p >> 11) & 0x1f) << 5;
+                g += ((p >> 6) & 0x1f) << 5;    /* top five bits of green */
+                b += (p & 0x1f) << 5;
+                count++;
+            }
+
+            if (!count)
+                continue;
+
+            ref_rgb16_chroma(r, g, b, count, &cb, &cr);
+            if (count == 4) {
+                *u = cb;
+                *v = cr;
+            } else {
+                *u = (cb * count + *u * (4 - count)) >> 2;
+                *v = (cr * count + *v * (4 - count)) >> 2;
+            }
+        }
+    }
+}
+
+static void verify_cc_case(const struct cc_case *c, int pattern)
+{
+    int src_words = c->src_pitch * c->src_height;
+    size_t size = c->dst_pitch * c->dst_height * 3 / 2;
+    uint16_t *src = (uint16_t *)malloc(src_words * 2);
+    uint16_t key = 0;
+    uint8_t *got, *want;
+    char what[64];
+
+    if (!src) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    fill_pattern16(src, src_words, pattern);
+    if (c->color_key && src_words > 0) {
+        /* a quarter of the pixels, so every count per block turns up */
+        key = src[0];
+        for (int i = 0; i < src_words; i++)
+            if (!(next_rand() & 3))
+                src[i] = key;
+    }
+
+    alloc_pair(size, &got, &want);
+
+    CCRGB16toYUV420 *cc = CCRGB16toYUV420::New();
+
+    snprintf(what, sizeof(what), "%s %dx%d p%d/%d r%d%s", sPatternNames[pattern],
+             c->dst_width, c->dst_height, c->src_pitch, c->dst_pitch,
+             c->rotation, c->color_key ? " key" : "");
+
+    /* Init() picks the 1:1 or the scale and rotate path by itself */
+    if (!cc->Init(c->src_width, c->src_height, c->src_pitch,
+                  c->dst_width, c->dst_height, c->dst_pitch, c->rotation)) {
+        sChecks++;
+        sFailures++;
+        printf("FAIL %-18s %4dx%-4d %-24s Init refused\n", "CCRGB16toYUV420",
+               c->src_width, c->src_height, what);
+    } else {
+        if (c->color_key)
+            cc->SetColorkey(key);
+        cc->Convert((uint8_t *)src, got);
+        ref_rgb16_to_yuv420(src, c, key, want);
+        check("CCRGB16toYUV420", c->src_width, c->src_height, what, got, want, size);
+    }
+
+    delete cc;
+    free(got);
+    free(want);
+    free(src);
+}
+
+static void verify_cc(void)
+{
+    static const int sizes[][2] = {
+        { 2, 2 }, { 8, 8 }, { 18, 10 }, { 176, 144 }, { 320, 240 },
+    };
+    static const int rotations[] = {
+        CCROTATE_NONE, CCROTATE_CNTRCLKWISE, CCROTATE_180, CCROTATE_CLKWISE,
+        CCFLIP, CCROTATE_CNTRCLKWISE | CCFLIP, CCROTATE_CLKWISE | CCFLIP,
+        CCBOTTOM_UP, CCROTATE_180 | CCBOTTOM_UP,
+    };
+
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int w = sizes[s][0], h = sizes[s][1];
+
+        for (int pattern = 0; pattern < PATTERN_MAX; pattern++) {
+            for (int pad = 0; pad <= 8; pad += 8) {
+                struct cc_case c;
+
+                /* 1:1 with and without the colour key */
+                c.src_width = c.dst_width = w;
+                c.src_height = c.dst_height = h;
+                c.src_pitch = w + pad;
+                c.dst_pitch = w + pad * 2;
+                c.rotation = CCROTATE_NONE;
+                c.color_key = false;
+                verify_cc_case(&c, pattern);
+                c.color_key = true;
+                verify_cc_case(&c, pattern);
+                c.color_key = false;
+
+                /* every orientation, at full size and scaled */
+                for (unsigned r = 0; r < sizeof(rotations) / sizeof(rotations[0]); r++) {
+                    bool swap = rotations[r] & 1;
+
+                    c.rotation = rotations[r];
+                    c.dst_width = swap ? h : w;
+                    c.dst_height = swap ? w : h;
+                    c.dst_pitch = c.dst_width + pad * 2;
+                    verify_cc_case(&c, pattern);
+
+                    /* down on one axis, up on the other */
+                    c.dst_width = (c.dst_width / 3 + 2) & ~1;
+                    c.dst_height = (c.dst_height * 3 / 2 + 1) & ~1;
+                    c.dst_pitch = c.dst_width + pad * 2;
+                    verify_cc_case(&c, pattern);
+                }
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+/* hwcomposer and copybit row copies */
+
+static void ref_blit_rows(uint8_t *dst, size_t dst_pitch,
+                          const uint8_t *src, size_t src_pitch,
+                          size_t row_bytes, int rows)
+{
+    for (int y = 0; y < rows; y++)
+        for (size_t x = 0; x < row_bytes; x++)
+            dst[y * dst_pitch + x] = src[y * src_pitch + x];
+}
+
+/* every engine this CPU has, heads and tails around the batches included */
+static void verify_blit_engine(int engine, sam_blit_fn blit)
+{
+    static const int row_bytes[] = { 1, 3, 7, 33, 64, 161, 1600 };
+    static const int rows[] = { 0, 1, 2, 17, 480 };
+    static const int pads[] = { 0, 1, 64 };
+    static const int offsets[] = { 0, 3 };
+    char name[32];
+
+    snprintf(name, sizeof(name), "sam_blit_rows/%s", sam_blit_engine_name(engine));
+
+    for (unsigned b = 0; b < sizeof(row_bytes) / sizeof(row_bytes[0]); b++)
+    for (unsigned r = 0; r < sizeof(rows) / sizeof(rows[0]); r++)
+    for (unsigned sp = 0; sp < sizeof(pads) / sizeof(pads[0]); sp++)
+    for (unsigned dp = 0; dp < sizeof(pads) / sizeof(pads[0]); dp++)
+    for (unsigned so = 0; so < sizeof(offsets) / sizeof(offsets[0]); so++)
+    for (unsigned dof = 0; dof < sizeof(offsets) / sizeof(offsets[0]); dof++) {
+        size_t src_pitch = row_bytes[b] + pads[sp];
+        size_t dst_pitch = row_bytes[b] + pads[dp];
+        size_t src_size = offsets[so] + src_pitch * rows[r] + 1;
+        size_t size = offsets[dof] + dst_pitch * rows[r];
+        uint8_t *src = (uint8_t *)malloc(src_size);
+        uint8_t *got, *want;
+        char what[64];
+
+        fill_noise(src, src_size);
+        alloc_pair(size, &got, &want);
+
+        blit(got + offsets[dof], dst_pitch, src + offsets[so], src_pitch,
+             row_bytes[b], rows[r]);
+        ref_blit_rows(want + offsets[dof], dst_pitch, src + offsets[so], src_pitch,
+                      row_bytes[b], rows[r]);
+
+        snprintf(what, sizeof(what), "pitch %lu/%lu +%d/+%d",
+                 (unsigned long)src_pitch, (unsigned long)dst_pitch,
+                 offsets[so], offsets[dof]);
+        check(name, row_bytes[b], rows[r], what, got, want, size);
+
+        free(got);
+        free(want);
+        free(src);
+    }
+}
+
+static void verify_blit(void)
+{
+    for (int engine = SAM_BLIT_AUTO + 1; engine < SAM_BLIT_ENGINES; engine++) {
+        sam_blit_fn blit = sam_blit_engine(engine);
+
+        if (blit)
+            verify_blit_engine(engine, blit);
+        else
+            printf("skip sam_blit_rows/%s, not on this CPU\n", sam_blit_engine_name(engine));
+    }
+    verify_blit_engine(SAM_BLIT_AUTO, sam_blit_rows);
+}
+
+/* the HEO copy of RGBA layers for drivers that only take BGR32 */
+static void verify_blit_swap_rb(void)
+{
+    static const int widths[] = { 1, 7, 64, 161 };
+    static const int rows[] = { 0, 1, 17 };
+    static const int pads[] = { 0, 4, 64 };
+    static const int offsets[] = { 0, 1 };
+
+    for (unsigned w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+    for (unsigned r = 0; r < sizeof(rows) / sizeof(rows[0]); r++)
+    for (unsigned p = 0; p < sizeof(pads) / sizeof(pads[0]); p++)
+    for (unsigned o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+        size_t src_pitch = widths[w] * 4 + pads[p];
+        size_t dst_pitch = widths[w] * 4 + pads[sizeof(pads) / sizeof(pads[0]) - 1 - p];
+        size_t src_size = offsets[o] + src_pitch * rows[r] + 1;
+        size_t size = dst_pitch * rows[r];
+        uint8_t *src = (uint8_t *)malloc(src_size);
+        uint8_t *got, *want;
+        char what[64];
+
+        fill_noise(src, src_size);
+        alloc_pair(size, &got, &want);
+
+        sam_blit_rows_swap_rb(got, dst_pitch, src + offsets[o], src_pitch,
+                              widths[w], rows[r]);
+        for (int y = 0; y < rows[r]; y++) {
+            const uint8_t *s = src + offsets[o] + y * src_pitch;
+            uint8_t *d = want + y * dst_pitch;
+
+            for (int x = 0; x < widths[w]; x++) {
+                d[x * 4] = s[x * 4 + 2];
+                d[x * 4 + 1] = s[x * 4 + 1];
+                d[x * 4 + 2] = s[x * 4];
+                d[x * 4 + 3] = s[x * 4 + 3];
+            }
+        }
+
+        snprintf(what, sizeof(what), "pitch %lu/%lu +%d",
+                 (unsigned long)src_pitch, (unsigned long)dst_pitch, offsets[o]);
+        check("sam_blit_rows_swap_rb", widths[w], rows[r], what, got, want, size);
+
+        free(got);
+        free(want);
+        free(src);
+    }
+}
+
+/*****************************************************************************/
+
+int pixverify(unsigned seed)
+{
+    sSeed = seed;
+    sChecks = 0;
+    sFailures = 0;
+
+    verify_yuyv();
+    verify_cc();
+    verify_blit();
+    verify_blit_swap_rb();
+
+    printf("%d checks, %d failed (seed %u)\n", sChecks, sFailures, seed);
+    return sFailures ? 1 : 0;
+}